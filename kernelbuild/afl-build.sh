@@ -1,5 +1,5 @@
 #!/bin/bash
-rm -f parser.afl parser.afl-redqueen
+rm -f parser.afl parser.afl-redqueen libmutator.so
 bazel clean
 CC=afl-clang-lto CXX=afl-clang-lto++ RANLIB=llvm-ranlib AR=llvm-ar AS=llvm-as bazel build //main:parser
 cp bazel-bin/main/parser parser.afl
@@ -12,3 +12,6 @@ cp bazel-bin/main/parser parser.afl
 bazel clean
 CC=afl-clang-lto CXX=afl-clang-lto++ RANLIB=llvm-ranlib AR=llvm-ar AS=llvm-as bazel build //main:parser --action_env="AFL_LLVM_CMPLOG=1"
 cp bazel-bin/main/parser parser.afl-redqueen
+# The custom mutator runs inside afl-fuzz and needs no instrumentation
+bazel build //main:libmutator.so
+cp bazel-bin/main/libmutator.so libmutator.so
@@ -13,14 +13,14 @@ ENV6="AFL_DISABLE_TRIM=1"
 ENV7="AFL_DISABLE_TRIM=1"
 ENV8="AFL_DISABLE_TRIM=1"
 ENV9="AFL_DISABLE_TRIM=1"
-ENV10=""
-ENV11=""
-ENV12=""
-ENV13=""
-ENV14=""
-ENV15=""
-ENV16=""
-ENV17=""
+ENV10="FUZZ_KERNEL_RULES=1"
+ENV11="FUZZ_KERNEL_RULES=1"
+ENV12="FUZZ_KERNEL_RULES=1"
+ENV13="FUZZ_KERNEL_RULES=1"
+ENV14="AFL_CUSTOM_MUTATOR_LIBRARY=./libmutator.so"
+ENV15="AFL_CUSTOM_MUTATOR_LIBRARY=./libmutator.so"
+ENV16="AFL_CUSTOM_MUTATOR_LIBRARY=./libmutator.so"
+ENV17="AFL_CUSTOM_MUTATOR_LIBRARY=./libmutator.so"
 ENV18=""
 ENV19=""
 ENV20="AFL_DISABLE_TRIM=1"
@@ -128,6 +128,7 @@ number_of_cpu=$1
 input_folder=input
 output_folder=output
 binary_name=./parser.afl
+snapshot=prelude.snap
 
 # safety clamp: script only honours the first 31 slaves (plus the master)
 (( number_of_cpu > 31 )) && number_of_cpu=31
@@ -135,14 +136,17 @@ binary_name=./parser.afl
 # ---------- helper to fetch per‑instance variables -------
 get_var () { local v="$1$2"; printf '%s' "${!v}"; }
 
+# ------------- check the prelude only once --------------
+"$binary_name" --save-snapshot "$snapshot" || exit 1
+
 # -------------------- launch master ---------------------
 env AFL_FORKSRV_INIT_TMOUT=1000000 AFL_AUTORESUME=1 $(get_var ENV 0) \
     screen -dmS Main bash -c \
-	"afl-fuzz -m 1024 -i \"$input_folder\" -o \"$output_folder\" -M Main $(get_var ARG 0) -- \"$binary_name$(get_var SUFF 0)\""
+	"afl-fuzz -m 1024 -i \"$input_folder\" -o \"$output_folder\" -M Main $(get_var ARG 0) -- \"$binary_name$(get_var SUFF 0)\" --load-snapshot \"$snapshot\""
 
 # -------------------- launch slaves ---------------------
 for (( idx=1; idx<=number_of_cpu; idx++ )); do
   env AFL_FORKSRV_INIT_TMOUT=1000000 AFL_AUTORESUME=1 $(get_var ENV $idx) \
       screen -dmS "Secondary$idx" bash -c \
-	  "afl-fuzz -m 1024 -i \"$input_folder\" -o \"$output_folder\" -S Secondary$idx $(get_var ARG $idx) -- \"$binary_name$(get_var SUFF $idx)\""
+	  "afl-fuzz -m 1024 -i \"$input_folder\" -o \"$output_folder\" -S Secondary$idx $(get_var ARG $idx) -- \"$binary_name$(get_var SUFF $idx)\" --load-snapshot \"$snapshot\""
 done
@@ -0,0 +1,5 @@
+#!/bin/bash
+rm -f parser.libfuzzer
+bazel clean
+CC=clang CXX=clang++ bazel build //main:fuzzer --copt=-fsanitize=fuzzer-no-link
+cp bazel-bin/main/fuzzer parser.libfuzzer
@@ -21,7 +21,9 @@ namespace lean {
 // extern "C" object* initialize_Std(uint8_t, object* w);
 // extern "C" object* initialize_Lean(uint8_t, object* w);
 extern "C" object* initialize_Lean_Environment(uint8_t, object* w);
+#ifndef LEAN_KERNEL_ONLY
 extern "C" object* initialize_Lean_Compiler_Old(uint8_t, object* w);
+#endif
 
 /* Initializes the Lean runtime. Before executing any code which uses the Lean package,
 you must first call this function, and then `lean::io_mark_end_initialization`. In between
@@ -40,7 +42,11 @@ extern "C" LEAN_EXPORT void lean_initialize() {
     // consume_io_result(initialize_Std(builtin, io_mk_world()));
     // consume_io_result(initialize_Lean(builtin, io_mk_world()));
     consume_io_result(initialize_Lean_Environment(builtin, io_mk_world()));
+#ifndef LEAN_KERNEL_ONLY
+    // Kernel-only builds compile every module in `lean_export/` except `Lean/Compiler/Old.c`, see
+    // `kernel_only` in `main/BUILD`
     consume_io_result(initialize_Lean_Compiler_Old(builtin, io_mk_world()));
+#endif
     initialize_kernel_module();
     init_default_print_fn();
     initialize_library_core_module();
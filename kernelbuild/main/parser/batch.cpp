@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "batch.h"
+#include "binparser.h"
+#include "mapped_file.h"
+#include "procstat.h"
+#include "runtime/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+std::vector<std::string> collect_inputs(std::vector<std::string> const & paths) {
+    std::vector<std::string> inputs;
+    for (std::string const & path : paths) {
+        if (!path.empty() && path[0] == '@') {
+            std::ifstream list(path.substr(1));
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    inputs.push_back(line);
+                }
+            }
+        } else if (std::filesystem::is_directory(path)) {
+            std::vector<std::string> files;
+            for (auto const & entry : std::filesystem::directory_iterator(path)) {
+                if (entry.is_regular_file()) {
+                    files.push_back(entry.path().string());
+                }
+            }
+            std::sort(files.begin(), files.end());
+            inputs.insert(inputs.end(), files.begin(), files.end());
+        } else {
+            inputs.push_back(path);
+        }
+    }
+    return inputs;
+}
+
+struct batch_row {
+    bool readable = false;
+    check_outcome outcome = check_outcome::accepted;
+    double parse_ms = 0;
+    double check_ms = 0;
+    size_t peak_rss_kb = 0;
+    size_t end_heap_kb = 0;
+    size_t heartbeats = 0;
+    size_t exprs = 0;
+    size_t shared_exprs = 0;
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static batch_row check_input(std::string const & input, StringPool const & strings,
+                             lean::environment const & prelude_env, check_budget const & budget,
+                             bool share_terms, bool measure_rss) {
+    batch_row row;
+    MappedFile data;
+    try {
+        data = MappedFile(input);
+    } catch (const std::filesystem::filesystem_error &) {
+        return row;
+    }
+    row.readable = true;
+
+    // The peak is process wide, so this is only done with a single worker
+    size_t rss_before = 0, peak_before = 0;
+    measure_rss = measure_rss && reset_peak_rss() && read_rss(rss_before, peak_before);
+
+    // Parsed first, so that parsing and checking are timed separately
+    auto start = std::chrono::steady_clock::now();
+    iteration_stats stats;
+    row.outcome = check_in_iteration_heap(data.data(), data.size(), strings, prelude_env, budget, share_terms,
+                                          &stats, true);
+    auto checked = std::chrono::steady_clock::now();
+
+    row.parse_ms = stats.parse_ms;
+    row.check_ms = std::max(elapsed_ms(start, checked) - stats.parse_ms, 0.0);
+    if (measure_rss) {
+        size_t rss = 0, peak = 0;
+        if (read_rss(rss, peak)) {
+            row.peak_rss_kb = peak > rss_before ? peak - rss_before : 0;
+        }
+    }
+    row.end_heap_kb = stats.heap_committed / 1024;
+    row.heartbeats = stats.heartbeats;
+    row.exprs = stats.sharing.exprs;
+    row.shared_exprs = stats.sharing.shared_exprs;
+    return row;
+}
+
+static std::string json_escape(std::string const & s) {
+    std::string result;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+static std::string csv_escape(std::string const & s) {
+    if (s.find_first_of(",\"\n") == std::string::npos) {
+        return s;
+    }
+    std::string result = "\"";
+    for (char c : s) {
+        if (c == '"') {
+            result += '"';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+static void write_row(std::ostream & out, std::string const & format, std::string const & input, batch_row const & row) {
+    char const * outcome = row.readable ? outcome_name(row.outcome) : "unreadable";
+    if (format == "json") {
+        out << "{\"file\": \"" << json_escape(input) << "\", \"outcome\": \"" << outcome
+            << "\", \"parse_ms\": " << row.parse_ms << ", \"check_ms\": " << row.check_ms
+            << ", \"peak_rss_kb\": " << row.peak_rss_kb << ", \"end_heap_kb\": " << row.end_heap_kb << ", \"heartbeats\": " << row.heartbeats
+            << ", \"exprs\": " << row.exprs << ", \"shared_exprs\": " << row.shared_exprs << "}\n";
+    } else {
+        out << csv_escape(input) << "," << outcome << "," << row.parse_ms << "," << row.check_ms
+            << "," << row.peak_rss_kb << "," << row.end_heap_kb << "," << row.heartbeats << "," << row.exprs << "," << row.shared_exprs << "\n";
+    }
+}
+
+int run_batch(std::vector<std::string> const & inputs, StringPool const & strings,
+              lean::environment const & prelude_env, check_budget const & budget,
+              batch_options const & options) {
+    unsigned jobs = std::max(1u, std::min<unsigned>(options.jobs, inputs.size()));
+    check_budget worker_budget = budget;
+    if (jobs > 1) {
+        // The resident set is shared by all workers, so a memory ceiling per testcase is meaningless
+        worker_budget.max_memory = 0;
+    }
+
+    std::vector<batch_row> rows(inputs.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < inputs.size(); i = next++) {
+            rows[i] = check_input(inputs[i], strings, prelude_env, worker_budget, options.share_terms, jobs == 1);
+        }
+    };
+
+    if (jobs == 1) {
+        worker();
+    } else {
+        std::vector<std::unique_ptr<lean::lthread>> threads;
+        for (unsigned i = 0; i < jobs; ++i) {
+            threads.emplace_back(new lean::lthread(worker));
+        }
+        for (auto & t : threads) {
+            t->join();
+        }
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+    }
+    std::ostream & out = options.output.empty() ? std::cout : file;
+    if (options.format != "json") {
+        out << "file,outcome,parse_ms,check_ms,peak_rss_kb,end_heap_kb,heartbeats,exprs,shared_exprs\n";
+    }
+    bool proof_of_false = false;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        write_row(out, options.format, inputs[i], rows[i]);
+        proof_of_false |= rows[i].readable && rows[i].outcome == check_outcome::proof_of_false;
+    }
+    out.flush();
+    return proof_of_false ? outcome_exit_code(check_outcome::proof_of_false) : 0;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "kernel/environment.h"
+
+/* Batch replay of many testcases (an AFL queue, `crashes/`, a corpus) in a single process.
+
+   The prelude is loaded once and the inputs are checked on `jobs` worker threads, which share the
+   persistent prelude environment. One row is written per input, in input order, with the outcome,
+   parse and check time in milliseconds, memory, the heartbeats spent, and the number of
+   expressions parsed and how many of them were shared (see `expr_sharing.h`, 0 unless sharing is
+   enabled).
+
+   Memory is reported as `peak_rss_kb`, how far the peak RSS of the process rose above the RSS
+   before the testcase, and `end_heap_kb`, the memory committed by the testcase's heap when
+   checking finished (pages that became empty may have been released before, so this is not the
+   peak). The peak RSS is process wide, so it is only measured with a single job and 0 otherwise.
+   Memory that mimalloc kept from earlier testcases is resident already, so the peak is a lower
+   bound.
+
+   A proof of `False` does not abort, it is reported like any other outcome. Crashes still take
+   down the whole batch. */
+
+struct batch_options {
+    unsigned jobs = 1;
+    // `csv`, or `json` for one JSON object per line
+    std::string format = "csv";
+    // Empty for stdout
+    std::string output;
+    bool share_terms = false;
+};
+
+// Expands `paths` into the list of inputs: directories contribute all regular files in them (sorted
+// by name), `@file` contributes the paths listed in `file`, one per line, and any other argument is
+// taken as an input itself.
+std::vector<std::string> collect_inputs(std::vector<std::string> const & paths);
+
+// Returns `outcome_exit_code(check_outcome::proof_of_false)` if any input proves `False`, and 0 otherwise.
+int run_batch(std::vector<std::string> const & inputs, StringPool const & strings,
+              lean::environment const & prelude_env, check_budget const & budget,
+              batch_options const & options);
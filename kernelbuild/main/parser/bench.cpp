@@ -0,0 +1,278 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "parser.h"
+#include "binparser.h"
+#include "harness.h"
+#include "kernel/declaration.h"
+#include "library/elab_environment.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+/* Kernel benchmark.
+
+   Replays `prelude.elean` (text format) and the given binary testcases (usually the `.belean`
+   files in `lean4export/ExportedCorpus`) `--runs` times and reports the median and percentiles
+   of every phase:
+   * `prelude.parse`, `corpus.parse`: `Parser::handle_file` and `BinParser::handle_data` of the
+     whole input, with the prelude split into chunks of 256 KiB so that it is tokenized on all
+     cores, and `prelude.parse.serial` the same on one thread,
+   * `prelude.add.<kind>`, `corpus.add.<kind>`: `elab_environment::add` and `environment::add`
+     (like `check_testcase`) respectively, per declaration kind,
+   * `corpus.exec`: parsing and checking a testcase the way the fuzzing loop does, which stops
+     parsing at the first rejected declaration,
+   * `*.shared`: the same with hash-consing in the parsers (see `expr_sharing.h`), followed by the
+     share of expressions that were deduplicated.
+
+   `--save-baseline F` writes the medians to `F`. `--baseline F` compares against them and exits
+   with 1 if a median got slower by more than `--threshold` percent (default 10). */
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// Samples in milliseconds, per phase
+using bench_samples = std::map<std::string, std::vector<double>>;
+
+template<typename Env, typename Decls>
+static void time_adds(Env & env, Decls const & decls, std::string const & prefix, bench_samples & samples) {
+    for (const lean::declaration & d : decls) {
+        auto start = bench_clock::now();
+        env = env.add(d);
+        samples[prefix + declaration_kind_name(d.kind())].push_back(elapsed_ms(start));
+    }
+}
+
+static void add_sharing_stats(sharing_stats & total, sharing_stats const & stats) {
+    total.exprs += stats.exprs;
+    total.levels += stats.levels;
+    total.shared_exprs += stats.shared_exprs;
+    total.shared_levels += stats.shared_levels;
+}
+
+// The prelude is smaller than `Parser::default_chunk_size`, and would be tokenized in one piece
+static constexpr size_t prelude_chunk_size = static_cast<size_t>(256) * 1024;
+
+static void bench_prelude(sz::string_view prelude, bench_samples & samples, sharing_stats & sharing) {
+    {
+        // For comparison with the default, which tokenizes on all cores
+        auto start = bench_clock::now();
+        Parser p(true, 1);
+        p.set_chunk_size(prelude_chunk_size);
+        p.handle_file(prelude);
+        samples["prelude.parse.serial"].push_back(elapsed_ms(start));
+    }
+    {
+        auto start = bench_clock::now();
+        Parser p(true, 0, true);
+        p.set_chunk_size(prelude_chunk_size);
+        p.handle_file(prelude);
+        samples["prelude.parse.shared"].push_back(elapsed_ms(start));
+        sharing = p.get_sharing_stats();
+    }
+
+    auto start = bench_clock::now();
+    Parser p(true);
+    p.set_chunk_size(prelude_chunk_size);
+    p.handle_file(prelude);
+    samples["prelude.parse"].push_back(elapsed_ms(start));
+    if (p.is_error()) {
+        throw lean::exception("failed to parse prelude.elean");
+    }
+
+    lean::elab_environment env = mk_empty_environment();
+    time_adds(env, p.get_decls(), "prelude.add.", samples);
+}
+
+static void bench_testcase(MappedFile const & data, StringPool const & strings,
+                           lean::environment const & prelude_env, check_budget const & budget,
+                           bench_samples & samples, sharing_stats * sharing) {
+    {
+        auto start = bench_clock::now();
+        BinParser p(strings);
+        p.handle_data(data.data(), data.size());
+        samples["corpus.parse"].push_back(elapsed_ms(start));
+
+        lean::environment env(prelude_env);
+        // Some corpus inputs only finish because of the budget, as in `check_testcase`
+        scope_check_budget scope(budget);
+        try {
+            time_adds(env, p.get_decls(), "corpus.add.", samples);
+        } catch (const lean::exception &) {
+            // Only the declarations before the first error, or the first over budget, are timed
+        } catch (const lean::heartbeat_exception &) {
+        } catch (const lean::stack_space_exception &) {
+        } catch (const lean::memory_exception &) {
+        }
+    }
+
+    {
+        // Parsing alone, since the iterations below stop parsing at the first rejected declaration
+        auto start = bench_clock::now();
+        BinParser p(strings, true);
+        p.handle_data(data.data(), data.size());
+        samples["corpus.parse.shared"].push_back(elapsed_ms(start));
+        if (sharing) {
+            add_sharing_stats(*sharing, p.get_sharing_stats());
+        }
+    }
+
+    // Same as an iteration of the AFL loop in `driver.cpp`
+    auto start = bench_clock::now();
+    check_in_iteration_heap(data.data(), data.size(), strings, prelude_env, budget);
+    samples["corpus.exec"].push_back(elapsed_ms(start));
+
+    start = bench_clock::now();
+    check_in_iteration_heap(data.data(), data.size(), strings, prelude_env, budget, true);
+    samples["corpus.exec.shared"].push_back(elapsed_ms(start));
+}
+
+static double percentile(std::vector<double> const & sorted, double q) {
+    size_t idx = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static std::map<std::string, double> read_baseline(std::string const & fname) {
+    // The format written by `write_baseline`: one `"phase": median,` per line
+    std::map<std::string, double> result;
+    std::ifstream in(fname);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t open = line.find('"');
+        size_t close = line.find('"', open + 1);
+        size_t colon = line.find(':', close);
+        if (open == std::string::npos || close == std::string::npos || colon == std::string::npos) {
+            continue;
+        }
+        result[line.substr(open + 1, close - open - 1)] = std::stod(line.substr(colon + 1));
+    }
+    return result;
+}
+
+static void write_baseline(std::string const & fname, std::map<std::string, double> const & medians) {
+    std::ofstream out(fname);
+    out << "{\n";
+    size_t i = 0;
+    for (auto const & [phase, median] : medians) {
+        out << "  \"" << phase << "\": " << median << (++i < medians.size() ? ",\n" : "\n");
+    }
+    out << "}\n";
+}
+
+int main(int argc, char * argv[]) {
+    initialize_runtime();
+
+    unsigned runs = 5;
+    double threshold = 10;
+    std::string baseline_fname;
+    std::string save_baseline_fname;
+    std::string load_snapshot_fname;
+    check_budget budget;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (int consumed = budget.parse_arg(argc, argv, i)) {
+            i += consumed - 1;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::stoul(argv[++i]);
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::stod(argv[++i]);
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_fname = argv[++i];
+        } else if (arg == "--save-baseline" && i + 1 < argc) {
+            save_baseline_fname = argv[++i];
+        } else if (arg == "--load-snapshot" && i + 1 < argc) {
+            load_snapshot_fname = argv[++i];
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    StringPool strings(read_strings());
+    MappedFile prelude = read_prelude();
+    // Mapped once and replayed from the page cache in every run
+    std::vector<MappedFile> testcases;
+    testcases.reserve(files.size());
+    for (std::string const & fname : files) {
+        try {
+            testcases.emplace_back(fname);
+        } catch (const std::filesystem::filesystem_error & ex) {
+            std::cout << fname << ": " << ex.code().message() << std::endl;
+            return setup_error_exit_code;
+        }
+    }
+
+    bench_samples samples;
+    sharing_stats prelude_sharing;
+    sharing_stats corpus_sharing;
+    try {
+        for (unsigned run = 0; run < runs; ++run) {
+            bench_prelude(sz::string_view(prelude.text().data(), prelude.size()), samples, prelude_sharing);
+        }
+    } catch (const lean::exception & ex) {
+        std::cout << ex.what() << std::endl;
+        return setup_error_exit_code;
+    }
+
+    lean::optional<lean::elab_environment> prelude_env = load_prelude(prelude.text(), load_snapshot_fname);
+    if (!prelude_env) {
+        return setup_error_exit_code;
+    }
+    lean::environment kernel_env = prelude_env->to_kernel_env();
+    for (unsigned run = 0; run < runs; ++run) {
+        for (MappedFile const & data : testcases) {
+            // Sharing is counted once per testcase
+            bench_testcase(data, strings, kernel_env, budget, samples, run == 0 ? &corpus_sharing : nullptr);
+        }
+    }
+
+    std::map<std::string, double> medians;
+    printf("%-28s %8s %12s %12s %12s %12s\n", "phase", "samples", "median ms", "p90 ms", "p99 ms", "max ms");
+    for (auto & [phase, values] : samples) {
+        std::sort(values.begin(), values.end());
+        medians[phase] = percentile(values, 0.5);
+        printf("%-28s %8zu %12.4f %12.4f %12.4f %12.4f\n", phase.c_str(), values.size(), medians[phase],
+               percentile(values, 0.9), percentile(values, 0.99), values.back());
+    }
+    if (!testcases.empty()) {
+        medians["corpus.exec_per_sec"] = 1000.0 / medians["corpus.exec"];
+        printf("%-28s %8s %12.1f\n", "corpus.exec_per_sec", "", medians["corpus.exec_per_sec"]);
+    }
+    print_sharing_stats("prelude sharing", prelude_sharing);
+    if (!testcases.empty()) {
+        print_sharing_stats("corpus sharing", corpus_sharing);
+    }
+
+    if (!save_baseline_fname.empty()) {
+        write_baseline(save_baseline_fname, medians);
+    }
+
+    int result = 0;
+    if (!baseline_fname.empty()) {
+        for (auto const & [phase, base] : read_baseline(baseline_fname)) {
+            auto it = medians.find(phase);
+            if (it == medians.end() || base <= 0) {
+                continue;
+            }
+            // Higher is better for throughput, lower is better for times
+            bool throughput = phase == "corpus.exec_per_sec";
+            double change = throughput ? (base - it->second) / base : (it->second - base) / base;
+            if (change * 100 > threshold) {
+                printf("REGRESSION %s: %.4f -> %.4f (%+.1f%%)\n", phase.c_str(), base, it->second, change * 100);
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Versions of the binary format.
+
+   Version 1 has no header. Indices are big-endian u16, and lengths of lists and literals are u8
+   (see the README of lean4export), so a testcase can address at most 65536 entries of a table.
+
+   Version 2 starts with a header: the marker "kfbin", the version byte 2 and a flags byte. If bit 0
+   of the flags is set, the numbers of name, level and expression records and of declarations
+   follow, so that readers can reserve their tables once. After the header, records are the same
+   as in version 1, except that every index, length and number in them (everything but the record
+   and subtype bytes and the bytes of literals) is an unsigned LEB128 varint.
+
+   Any input without the v2 header is read as version 1, so the existing corpus and arbitrary
+   fuzzer inputs keep their meaning. */
+
+constexpr char bin_marker[5] = { 'k', 'f', 'b', 'i', 'n' };
+constexpr std::uint8_t bin_flag_sizes = 0x1;
+
+struct bin_header {
+    unsigned version = 1;
+    // Number of records of each kind, 0 if the input does not say
+    std::uint64_t num_names = 0;
+    std::uint64_t num_levels = 0;
+    std::uint64_t num_exprs = 0;
+    std::uint64_t num_decls = 0;
+};
+
+// Reads an unsigned LEB128 varint. Bits beyond the 64th are dropped, and a varint that is cut off
+// by the end of the input ends there.
+inline std::uint64_t read_uleb(const std::uint8_t *& buf, std::uint64_t & len) {
+    std::uint64_t result = 0;
+    unsigned shift = 0;
+    while (len > 0) {
+        std::uint8_t byte = *buf++;
+        --len;
+        if (shift < 64) {
+            result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    return result;
+}
+
+inline void write_uleb(std::vector<std::uint8_t> & out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+// Skips the header of a version 2 input. Leaves other inputs alone, they are version 1.
+inline bin_header read_bin_header(const std::uint8_t *& buf, std::uint64_t & len) {
+    bin_header header;
+    constexpr size_t prefix = sizeof(bin_marker) + 2;
+    if (len < prefix || std::memcmp(buf, bin_marker, sizeof(bin_marker)) != 0 || buf[sizeof(bin_marker)] != 2) {
+        return header;
+    }
+    header.version = 2;
+    std::uint8_t flags = buf[sizeof(bin_marker) + 1];
+    buf += prefix;
+    len -= prefix;
+    if (flags & bin_flag_sizes) {
+        header.num_names = read_uleb(buf, len);
+        header.num_levels = read_uleb(buf, len);
+        header.num_exprs = read_uleb(buf, len);
+        header.num_decls = read_uleb(buf, len);
+    }
+    return header;
+}
+
+// Writes a version 2 header with sizes
+inline void write_bin_header(std::vector<std::uint8_t> & out, const bin_header & header) {
+    out.insert(out.end(), bin_marker, bin_marker + sizeof(bin_marker));
+    out.push_back(2);
+    out.push_back(bin_flag_sizes);
+    write_uleb(out, header.num_names);
+    write_uleb(out, header.num_levels);
+    write_uleb(out, header.num_exprs);
+    write_uleb(out, header.num_decls);
+}
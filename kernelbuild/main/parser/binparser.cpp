@@ -6,6 +6,8 @@ Author: Markus Himmel
 */
 #include "binparser.h"
 
+#include <algorithm>
+
 //#define MARKUS_DEBUG
 
 #ifdef MARKUS_DEBUG
@@ -38,17 +40,33 @@ std::uint32_t BinParser::parse_u32() {
     return (high << 16) | low;
 }
 
-std::string BinParser::parse_string() {
-    std::uint16_t idx = parse_u16();
+std::uint64_t BinParser::parse_uleb() {
+    return read_uleb(cur, remaining_len);
+}
+
+std::uint64_t BinParser::parse_idx() {
+    return version == 1 ? parse_u16() : parse_uleb();
+}
+
+std::uint64_t BinParser::parse_len() {
+    if (version == 1) {
+        return parse_u8();
+    }
+    // Every element takes at least a byte. Beyond the end, version 1 reads zeros for up to 255
+    // elements, but a varint length could make that take forever.
+    return std::min(parse_uleb(), remaining_len);
+}
+
+std::uint64_t BinParser::parse_string_idx() {
+    std::uint64_t idx = parse_idx();
     if (idx > strings.size()) {
         dbgf("bad string index\n");
     }
-    std::string ans = strings[idx % strings.size()];
-    return ans;
+    return idx;
 }
 
 lean::level BinParser::parse_level_idx() {
-    std::uint16_t idx = parse_u16();
+    std::uint64_t idx = parse_idx();
     if (idx >= levels.size()) {
         dbgf("bad level index\n");
     }
@@ -56,7 +74,7 @@ lean::level BinParser::parse_level_idx() {
 }
 
 lean::name BinParser::parse_name_idx(bool allowAnon) {
-    std::uint16_t pidx = parse_u16();
+    std::uint64_t pidx = parse_idx();
     if (pidx >= names.size()) {
         dbgf("bad name index\n");
     }
@@ -70,21 +88,43 @@ lean::name BinParser::parse_name_idx(bool allowAnon) {
     return n;
 }
 
+// The big-endian number in the `len` bytes at `buf`. Appending a byte at a time is quadratic in
+// `len`, which a version 2 literal as long as the input makes take seconds. Splitting the bytes in
+// halves, which are only shifted and added, takes O(len log len).
+static lean::mpz bytes_to_mpz(const std::uint8_t * buf, std::uint64_t len) {
+    if (len <= 8) {
+        std::uint64_t v = 0;
+        for (std::uint64_t i = 0; i < len; ++i) {
+            v = (v << 8) | buf[i];
+        }
+        return lean::mpz(static_cast<lean::uint64>(v));
+    }
+    std::uint64_t low_len = len / 2;
+    lean::mpz result;
+    mul2k(result, bytes_to_mpz(buf, len - low_len), static_cast<unsigned>(8 * low_len));
+    result += bytes_to_mpz(buf + len - low_len, low_len);
+    return result;
+}
+
 lean::mpz BinParser::parse_natlit() {
-    lean::mpz result(0);
-    std::uint8_t len = parse_u8();
-    for (std::uint8_t i = 0; i < len; ++i) {
-        result *= 256;
-        std::uint8_t byte = parse_u8();
-        result += byte;
+    std::uint64_t len = parse_len();
+    // Only the length of version 1 can go beyond the end of the input
+    std::uint64_t avail = std::min(len, remaining_len);
+    lean::mpz result = bytes_to_mpz(cur, avail);
+    cur += avail;
+    remaining_len -= avail;
+    if (avail < len) {
+        dbgf("Read over the end\n");
+        // The missing bytes read as zeros, like in `parse_u8`
+        mul2k(result, result, static_cast<unsigned>(8 * (len - avail)));
     }
     return result;
 }
 
 std::string BinParser::parse_strlit() {
     std::string result;
-    std::uint8_t len = parse_u8();
-    for (std::uint8_t i = 0; i < len; ++i) {
+    std::uint64_t len = parse_len();
+    for (std::uint64_t i = 0; i < len; ++i) {
         std::uint8_t byte = parse_u8();
         char c = (char)byte;
         result.push_back(c);
@@ -102,7 +142,7 @@ lean::reducibility_hints BinParser::parse_hint() {
             return lean::reducibility_hints::mk_abbreviation();
         }
         case 2: {
-            std::uint32_t v = parse_u32();
+            std::uint32_t v = version == 1 ? parse_u32() : parse_uleb();
             return lean::reducibility_hints::mk_regular(v);
         }
     }
@@ -138,7 +178,7 @@ lean::constructor BinParser::any_constructor() {
 }
 
 lean::expr BinParser::parse_expr_idx() {
-    std::uint16_t idx = parse_u16();
+    std::uint64_t idx = parse_idx();
     if (idx >= exprs.size()) {
         dbgf("bad expr index\n");
     } 
@@ -151,11 +191,11 @@ lean::expr BinParser::parse_expr_idx() {
 }
 
 template<typename T>
-std::vector<T> BinParser::parse_objs(const std::vector<T> & objs) {
+std::vector<T> BinParser::parse_objs(const vector<T> & objs) {
     std::vector<T> result;
-    std::uint16_t amt = parse_u8();
-    for (std::uint16_t i = 0; i < amt; ++i) {
-        std::uint16_t num = parse_u16();
+    std::uint64_t amt = parse_len();
+    for (std::uint64_t i = 0; i < amt; ++i) {
+        std::uint64_t num = parse_idx();
         result.push_back(objs[num % objs.size()]);
     }
     return result;
@@ -177,21 +217,33 @@ void BinParser::parse_name() {
     switch (nameType % 2) {
         case 0: {
             lean::name parent = parse_name_idx(true);
-            std::string comp = parse_string();
-            lean::name n(parent, lean::string_ref(comp));
-            names.push_back(n);
+            std::uint64_t comp = parse_string_idx();
+            // Names with a single component come ready-made from the pool
+            if (parent.is_anonymous()) {
+                names.push_back(strings.get_name(comp));
+            } else {
+                names.push_back(lean::name(parent, strings.get_string_ref(comp)));
+            }
             break;
         }
         case 1: {
             lean::name parent = parse_name_idx(true);
-            std::uint16_t comp = parse_u16();
-            lean::name n(parent, comp);
+            std::uint64_t comp = parse_idx();
+            lean::name n(parent, lean::nat(comp));
             names.push_back(n);
             break;
         }
     }
 }
 
+void BinParser::push_level(lean::level const & l) {
+    levels.push_back(share_terms ? sharing.share(l) : l);
+}
+
+void BinParser::push_expr(lean::expr const & e) {
+    exprs.push_back(share_terms ? sharing.share(e) : e);
+}
+
 void BinParser::parse_level() {
     dbgf("Level\n");
     std::uint8_t levelType = parse_u8();
@@ -199,47 +251,51 @@ void BinParser::parse_level() {
         case 0: {
             lean::level parent = parse_level_idx();
             lean::level l = lean::mk_succ(parent);
-            levels.push_back(l);
+            push_level(l);
             break;
         }
         case 1: {
             lean::level lhs = parse_level_idx();
             lean::level rhs = parse_level_idx();
             lean::level l = lean::mk_max(lhs, rhs);
-            levels.push_back(l);
+            push_level(l);
             break;
         }
         case 2: {
             lean::level lhs = parse_level_idx();
             lean::level rhs = parse_level_idx();
             lean::level l = lean::mk_imax(lhs, rhs);
-            levels.push_back(l);
+            push_level(l);
             break;
         }
         case 3: {
             lean::name n = parse_name_idx(false);
             lean::level l = lean::mk_univ_param(n);
-            levels.push_back(l);
+            push_level(l);
             break;
         }
     }
 }
 
+// `Expr.mkData` panics unless the loose bound variable range, one more than the index, is at most
+// 2^20 - 1. Larger indices (only possible in version 2) are reduced like other out-of-range indices.
+static constexpr std::uint64_t bvar_idx_bound = (static_cast<std::uint64_t>(1) << 20) - 1;
+
 void BinParser::parse_expression() {
     std::uint8_t expressionType = parse_u8();
     switch (expressionType % 10) {
         case 0: { // Bound variable
-            std::uint64_t deBruijnIndex = parse_u16();
+            std::uint64_t deBruijnIndex = parse_idx() % bvar_idx_bound;
             dbgf("Bound variable %d\n", deBruijnIndex);
             lean::expr e = lean::mk_bvar(lean::nat(deBruijnIndex));
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 1: { // Sort
             // dbgf("Sort\n");
             lean::level universe = parse_level_idx();
             lean::expr e = lean::mk_sort(universe);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 2: { // Constant
@@ -247,7 +303,7 @@ void BinParser::parse_expression() {
             lean::name name = parse_name_idx(false);
             lean::levels levels = parse_levels();
             lean::expr e = lean::mk_const(name, levels);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 3: { // App
@@ -255,7 +311,7 @@ void BinParser::parse_expression() {
             lean::expr lhs = parse_expr_idx();
             lean::expr rhs = parse_expr_idx();
             lean::expr e = lean::mk_app(lhs, rhs);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 4: { // Lambda
@@ -264,7 +320,7 @@ void BinParser::parse_expression() {
             lean::expr binderType = parse_expr_idx();
             lean::expr body = parse_expr_idx();
             lean::expr e = lean::mk_lambda(binderName, binderType, body);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 5: { // Pi
@@ -273,7 +329,7 @@ void BinParser::parse_expression() {
             lean::expr binderType = parse_expr_idx();
             lean::expr body = parse_expr_idx();
             lean::expr e = lean::mk_pi(binderName, binderType, body);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 6: { // Let
@@ -283,30 +339,30 @@ void BinParser::parse_expression() {
             lean::expr boundValue = parse_expr_idx();
             lean::expr body = parse_expr_idx();
             lean::expr e = lean::mk_let(binderName, binderType, boundValue, body);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 7: { // Projection
             // dbgf("Proj\n");
             lean::name typeName = parse_name_idx(false);
-            std::uint16_t fieldIndex = parse_u16();
+            std::uint64_t fieldIndex = parse_idx();
             lean::expr value = parse_expr_idx();
             lean::expr e = lean::mk_proj(typeName, fieldIndex, value);
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 8: { // Nat literal
             // dbgf("Natlit\n");
             lean::mpz lit = parse_natlit();
             lean::expr e = lean::mk_lit(lean::literal(lit));
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
         case 9: { // String literal
             // dbgf("Strlit\n");
             std::string lit = parse_strlit();
             lean::expr e = lean::mk_lit(lean::literal(lit.c_str()));
-            exprs.push_back(e);
+            push_expr(e);
             break;
         }
     }
@@ -321,7 +377,7 @@ void BinParser::parse_definition() {
     lean::names universeParameters = parse_names();
 
     lean::declaration d = lean::mk_definition(name, universeParameters, type, value, hint);
-    decls.push_back(d);
+    ready = d;
 }
 
 void BinParser::parse_theorem() {
@@ -332,7 +388,7 @@ void BinParser::parse_theorem() {
     lean::names universeParameters = parse_names();
 
     lean::declaration d = lean::mk_theorem(name, universeParameters, type, value);
-    decls.push_back(d);
+    ready = d;
 }
 
 void BinParser::parse_inductive() {
@@ -361,7 +417,7 @@ void BinParser::parse_inductive() {
 
 void BinParser::parse_inductive_family() {
     dbgf("Inductive family\n");
-    std::uint16_t numParams = parse_u8();
+    std::uint64_t numParams = version == 1 ? parse_u8() : parse_uleb();
     std::vector<lean::name> inductiveNames = parse_objs<lean::name>(names);
     lean::names universeParameters = parse_names();
     
@@ -379,7 +435,7 @@ void BinParser::parse_inductive_family() {
 
     lean::inductive_types inductivesList = lean::list_ref<lean::inductive_type>(inductivesVec.begin(), inductivesVec.end());
     lean::declaration d = lean::mk_inductive_decl(universeParameters, lean::nat(numParams), inductivesList, false);
-    decls.push_back(d);
+    ready = d;
 }
 
 void BinParser::parse_constructor() {
@@ -421,46 +477,297 @@ void BinParser::parse_line() {
     }
 }
 
+std::uint32_t BinParser::scan_name_idx(bool allowAnon, std::uint32_t & slot) {
+    std::uint64_t idx = parse_idx() % liveness.size(parser_table::names);
+    if (idx == 0 && !allowAnon) {
+        slot = TableLiveness::no_slot;
+        return liveness.name_key(0, "foo42");
+    }
+    liveness.use(parser_table::names, idx);
+    slot = idx;
+    return liveness.key_of(idx);
+}
+
+void BinParser::scan_level_idx() {
+    liveness.use(parser_table::levels, parse_idx() % liveness.size(parser_table::levels));
+}
+
+void BinParser::scan_expr_idx() {
+    std::uint64_t idx = parse_idx();
+    if (liveness.size(parser_table::exprs) > 0) {
+        liveness.use(parser_table::exprs, idx % liveness.size(parser_table::exprs));
+    }
+}
+
+void BinParser::scan_objs(parser_table table, std::vector<std::uint32_t> * slots) {
+    std::uint64_t amt = parse_len();
+    for (std::uint64_t i = 0; i < amt; ++i) {
+        std::uint64_t slot = parse_idx() % liveness.size(table);
+        liveness.use(table, slot);
+        if (slots) {
+            slots->push_back(slot);
+        }
+    }
+}
+
+void BinParser::scan_literal() {
+    std::uint64_t len = std::min(parse_len(), remaining_len);
+    cur += len;
+    remaining_len -= len;
+}
+
+void BinParser::scan_line() {
+    std::uint32_t slot;
+    std::uint8_t declType = parse_u8();
+    switch (declType % 8) {
+        case 0: { // Level
+            std::uint8_t levelType = parse_u8();
+            switch (levelType % 4) {
+                case 0:
+                    scan_level_idx();
+                    break;
+                case 1: case 2:
+                    scan_level_idx();
+                    scan_level_idx();
+                    break;
+                case 3:
+                    scan_name_idx(false, slot);
+                    break;
+            }
+            liveness.add(parser_table::levels);
+            break;
+        }
+        case 1: { // Expr
+            std::uint8_t expressionType = parse_u8();
+            switch (expressionType % 10) {
+                case 0:
+                    parse_idx();
+                    break;
+                case 1:
+                    scan_level_idx();
+                    break;
+                case 2:
+                    scan_name_idx(false, slot);
+                    scan_objs(parser_table::levels, nullptr);
+                    break;
+                case 3:
+                    scan_expr_idx();
+                    scan_expr_idx();
+                    break;
+                case 4: case 5:
+                    scan_name_idx(true, slot);
+                    scan_expr_idx();
+                    scan_expr_idx();
+                    break;
+                case 6:
+                    scan_name_idx(false, slot);
+                    scan_expr_idx();
+                    scan_expr_idx();
+                    scan_expr_idx();
+                    break;
+                case 7:
+                    scan_name_idx(false, slot);
+                    parse_idx();
+                    scan_expr_idx();
+                    break;
+                case 8: case 9:
+                    scan_literal();
+                    break;
+            }
+            liveness.add(parser_table::exprs);
+            break;
+        }
+        case 2: // Def
+            scan_name_idx(false, slot);
+            scan_expr_idx();
+            scan_expr_idx();
+            if (parse_u8() % 3 == 2) {
+                version == 1 ? parse_u32() : parse_uleb();
+            }
+            scan_objs(parser_table::names, nullptr);
+            break;
+        case 3: // Theorem
+            scan_name_idx(false, slot);
+            scan_expr_idx();
+            scan_expr_idx();
+            scan_objs(parser_table::names, nullptr);
+            break;
+        case 4: { // Inductive
+            std::uint32_t key = scan_name_idx(false, slot);
+            scan_expr_idx();
+            std::vector<std::uint32_t> ctors;
+            scan_objs(parser_table::names, &ctors);
+            for (std::uint32_t ctor : ctors) {
+                if (!liveness.lookup(parser_table::constructors, liveness.key_of(ctor), ctor)) {
+                    // `any_constructor`
+                    liveness.use_back(parser_table::names);
+                    liveness.use_back(parser_table::exprs);
+                }
+            }
+            liveness.insert(parser_table::inductives, key, slot);
+            break;
+        }
+        case 5: { // Inductive Family
+            version == 1 ? parse_u8() : parse_uleb();
+            std::vector<std::uint32_t> inds;
+            scan_objs(parser_table::names, &inds);
+            scan_objs(parser_table::names, nullptr);
+            for (std::uint32_t ind : inds) {
+                if (!liveness.lookup(parser_table::inductives, liveness.key_of(ind), ind)) {
+                    // `any_inductive`
+                    liveness.use_back(parser_table::names);
+                    liveness.use_back(parser_table::exprs);
+                }
+            }
+            break;
+        }
+        case 6: { // Constructor
+            std::uint32_t key = scan_name_idx(false, slot);
+            scan_expr_idx();
+            liveness.insert(parser_table::constructors, key, slot);
+            break;
+        }
+        case 7: { // Name
+            std::uint8_t nameType = parse_u8();
+            std::uint32_t parent = scan_name_idx(true, slot);
+            if (nameType % 2 == 0) {
+                liveness.add_name(liveness.name_key(parent, strings.get_string(parse_string_idx())));
+            } else {
+                liveness.add_name(liveness.name_key(parent, parse_idx()));
+            }
+            break;
+        }
+    }
+    liveness.end_record();
+}
+
+// Goes through the input once without building anything, and leaves the position alone
+void BinParser::scan_liveness() {
+    const std::uint8_t * start_cur = cur;
+    std::uint64_t start_len = remaining_len;
+    while (remaining_len > 0) {
+        scan_line();
+    }
+    liveness.finish();
+    cur = start_cur;
+    remaining_len = start_len;
+}
+
+void BinParser::release_dead() {
+    liveness.release_record([&](const TableLiveness::release & r) {
+        switch (r.table) {
+            case parser_table::names:
+                names[r.slot] = lean::name();
+                break;
+            case parser_table::levels:
+                levels[r.slot] = lean::level();
+                break;
+            case parser_table::exprs:
+                exprs[r.slot] = lean::expr();
+                break;
+            case parser_table::constructors: case parser_table::inductives: {
+                // See `parse_name_idx`
+                lean::name key = r.slot == TableLiveness::no_slot
+                    ? lean::name(lean::name::anonymous(), lean::string_ref("foo42"))
+                    : names[r.slot];
+                if (r.table == parser_table::constructors) {
+                    constructors.erase(key);
+                } else {
+                    inductives.erase(key);
+                }
+                break;
+            }
+        }
+    });
+}
+
 void BinParser::handle_data(const std::uint8_t *buf, std::uint64_t len) {
+    start(buf, len);
+    while (lean::optional<lean::declaration> d = next_declaration()) {
+        decls.push_back(*d);
+    }
+}
+
+void BinParser::start(const std::uint8_t *buf, std::uint64_t len) {
+    bin_header header = read_bin_header(buf, len);
+    version = header.version;
     cur = buf;
     remaining_len = len;
 
+    // Sizes beyond one record per byte are wrong, and not worth reserving for
+    names.reserve(names.size() + std::min(header.num_names, len));
+    levels.reserve(levels.size() + std::min(header.num_levels, len));
+    exprs.reserve(exprs.size() + std::min(header.num_exprs, len));
+    decls.reserve(decls.size() + std::min(header.num_decls, len));
+
+    if (track_liveness) {
+        scan_liveness();
+    }
+}
+
+lean::optional<lean::declaration> BinParser::next_declaration() {
     while (remaining_len > 0) {
         parse_line();
+        if (track_liveness) {
+            release_dead();
+        }
+        if (ready) {
+            lean::declaration d = *ready;
+            ready = lean::none_declaration();
+            return lean::some_declaration(d);
+        }
     }
+    return lean::none_declaration();
 }
 
-BinParser::BinParser(const std::vector<std::string> & _strings) :
+BinParser::BinParser(const StringPool & _strings, bool share, bool _track_liveness) :
         cur(nullptr),
         remaining_len(0),
+        version(1),
+        share_terms(share),
+        track_liveness(_track_liveness),
         strings(_strings),
         exprs(),
         names(),
         levels(),
         decls(),
+        ready(),
         constructors(),
-        inductives() {
+        inductives(),
+        sharing(),
+        liveness() {
     levels.push_back(lean::mk_level_zero());
     names.push_back(lean::name::anonymous());
 }
 
-const std::vector<lean::declaration> & BinParser::get_decls() const {
+const BinParser::vector<lean::declaration> & BinParser::get_decls() const {
     return decls;
 }
 
+const sharing_stats & BinParser::get_sharing_stats() const {
+    return sharing.get_stats();
+}
+
+const liveness_stats & BinParser::get_liveness_stats() const {
+    return liveness.get_stats();
+}
+
 bool BinParser::add_false() {
-    if (exprs.empty()) {
+    lean::optional<lean::declaration> d = false_declaration();
+    if (!d) {
         return false;
     }
+    decls.push_back(*d);
+    return true;
+}
+
+lean::optional<lean::declaration> BinParser::false_declaration() const {
+    if (exprs.empty()) {
+        return lean::none_declaration();
+    }
     lean::expr possibleProof = exprs.back();
 
-    lean::name falseName(names[0], lean::string_ref("False"));
-    
-    lean::expr falseType = lean::mk_const(falseName);
-    
-    lean::name fooName(names[0], lean::string_ref("foo"));
+    lean::expr falseType = lean::mk_const(strings.get_false_name());
 
-    lean::declaration d = lean::mk_theorem(fooName, lean::names(), falseType, possibleProof);
-    decls.push_back(d);
-    return true;
+    return lean::some_declaration(lean::mk_theorem(strings.get_foo_name(), lean::names(), falseType, possibleProof));
 }
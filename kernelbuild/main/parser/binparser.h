@@ -9,31 +9,66 @@ Author: Markus Himmel
 #include "kernel/level.h"
 #include "kernel/declaration.h"
 #include "util/name_hash_map.h"
+#include "util/alloc.h"
+#include "string_pool.h"
+#include "binformat.h"
+#include "expr_sharing.h"
+#include "liveness.h"
 #include <vector>
 
 class BinParser {
 public:
-    BinParser(const std::vector<std::string> & strings);
+    // All containers of the parser allocate through `lean::allocator`, so that they live in the
+    // same mimalloc heap as the Lean objects they hold (see `IterationHeap`).
+    template<typename T> using vector = std::vector<T, lean::allocator<T>>;
+    template<typename T> using name_map = lean::unordered_map<lean::name, T, lean::name_hash_fn, lean::name_eq_fn>;
 
+    // `strings` is borrowed and must outlive the parser. With `share`, structurally equal levels
+    // and expressions are built once, see `expr_sharing.h`. With `track_liveness`, `start` scans
+    // the input first and table entries are released after their last use, see `liveness.h`.
+    BinParser(const StringPool & strings, bool share = false, bool track_liveness = false);
+
+    // Reads version 1 or 2 of the binary format, see `binformat.h`
     void handle_data(const std::uint8_t *buf, std::uint64_t len);
 
-    const std::vector<lean::declaration> & get_decls() const;
+    const vector<lean::declaration> & get_decls() const;
+
+    // All zero unless sharing is enabled
+    const sharing_stats & get_sharing_stats() const;
+    // All zero unless liveness is tracked
+    const liveness_stats & get_liveness_stats() const;
 
     // Returns false if it was not added
     bool add_false();
 
+    /* Streaming. After `start`, every call to `next_declaration` parses records until the next
+       declaration is complete and returns it, or none at the end of the input. Declarations
+       returned this way are not added to `get_decls`, and the input is not read further than
+       requested, so a consumer can stop early. `handle_data` is `start` followed by
+       `next_declaration` until the end. `buf` must stay alive until the end is reached. */
+    void start(const std::uint8_t *buf, std::uint64_t len);
+    lean::optional<lean::declaration> next_declaration();
+    // The theorem `add_false` adds, or none if there are no expressions. Which expression it
+    // uses is only settled at the end of the input.
+    lean::optional<lean::declaration> false_declaration() const;
+
 private:
     /* Basic parsing functions */
     std::uint8_t parse_u8();
     std::uint16_t parse_u16();
     std::uint32_t parse_u32();
-    std::string parse_string();
+    std::uint64_t parse_uleb();
+    // An index or number: u16 in version 1, a varint in version 2
+    std::uint64_t parse_idx();
+    // The length of a list or literal: u8 in version 1, a varint in version 2
+    std::uint64_t parse_len();
+    std::uint64_t parse_string_idx();
 
     /* Parsing of lean-specific objects */
     lean::level parse_level_idx();
     lean::name parse_name_idx(bool allowAnon);
     lean::expr parse_expr_idx();
-    template<typename T> std::vector<T> parse_objs(const std::vector<T> & objs);
+    template<typename T> std::vector<T> parse_objs(const vector<T> & objs);
     lean::levels parse_levels();
     lean::names parse_names();
     lean::mpz parse_natlit();
@@ -48,6 +83,8 @@ private:
     lean::inductive_type any_inductive();
 
     /* Parsing of specific constructions */
+    void push_level(lean::level const & l);
+    void push_expr(lean::expr const & e);
     void parse_name();
     void parse_level();
     void parse_expression();
@@ -59,21 +96,37 @@ private:
 
     void parse_line();
 
+    /* Liveness, mirroring the parsing functions above */
+    std::uint32_t scan_name_idx(bool allowAnon, std::uint32_t & slot);
+    void scan_level_idx();
+    void scan_expr_idx();
+    void scan_objs(parser_table table, std::vector<std::uint32_t> * slots);
+    void scan_literal();
+    void scan_line();
+    void scan_liveness();
+    void release_dead();
+
     /* Data members */
 
     const std::uint8_t * cur;
     std::uint64_t remaining_len;
+    unsigned version;
+    bool share_terms;
+    bool track_liveness;
     
-    std::vector<std::string> strings;
+    const StringPool & strings;
 
-    std::vector<lean::expr> exprs;
-    std::vector<lean::name> names;
-    std::vector<lean::level> levels;
+    vector<lean::expr> exprs;
+    vector<lean::name> names;
+    vector<lean::level> levels;
 
-    std::vector<lean::declaration> decls;
+    vector<lean::declaration> decls;
+    // The declaration completed by the last record, see `next_declaration`
+    lean::optional<lean::declaration> ready;
 
-    lean::name_hash_map<lean::constructor> constructors;
-    lean::name_hash_map<lean::inductive_type> inductives;
-    
-    
+    name_map<lean::constructor> constructors;
+    name_map<lean::inductive_type> inductives;
+
+    ExprSharing sharing;
+    TableLiveness liveness;
 };
\ No newline at end of file
@@ -5,6 +5,8 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Markus Himmel
 */
 #include "binprinter.h"
+#include "mapped_file.h"
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <filesystem>
@@ -43,17 +45,28 @@ std::uint32_t BinPrinter::parse_u32() {
     return (high << 16) | low;
 }
 
+std::uint64_t BinPrinter::parse_uleb() {
+    return read_uleb(cur, remaining_len);
+}
+
+std::uint64_t BinPrinter::parse_idx() {
+    return version == 1 ? parse_u16() : parse_uleb();
+}
+
+std::uint64_t BinPrinter::parse_len() {
+    return version == 1 ? parse_u8() : std::min(parse_uleb(), remaining_len);
+}
+
 std::string BinPrinter::parse_string() {
-    std::uint16_t idx = parse_u16();
+    std::uint64_t idx = parse_idx();
     if (idx > strings.size()) {
         dbgf("bad string index\n");
     }
-    std::string ans = strings[idx % strings.size()];
-    return ans;
+    return strings.get_string(idx);
 }
 
 std::string BinPrinter::parse_level_idx() {
-    std::uint16_t idx = parse_u16();
+    std::uint64_t idx = parse_idx();
     if (idx >= numLevels) {
         dbgf("bad level index\n");
     }
@@ -63,7 +76,7 @@ std::string BinPrinter::parse_level_idx() {
 }
 
 std::string BinPrinter::parse_name_idx(bool allowAnon) {
-    std::uint16_t pidx = parse_u16();
+    std::uint64_t pidx = parse_idx();
     if (pidx >= names.size()) {
         dbgf("bad name index\n");
     }
@@ -78,7 +91,7 @@ std::string BinPrinter::parse_name_idx(bool allowAnon) {
 }
 
 std::pair<std::string, lean::name> BinPrinter::parse_name_with_idx(bool allowAnon) {
-    std::uint16_t pidx = parse_u16();
+    std::uint64_t pidx = parse_idx();
     std::uint64_t idx = pidx % names.size();
     if (idx == 0 && !allowAnon) {
         lean::name n(lean::name::anonymous(), lean::string_ref("foo42"));
@@ -88,10 +101,10 @@ std::pair<std::string, lean::name> BinPrinter::parse_name_with_idx(bool allowAno
 }
 
 std::string BinPrinter::parse_levels() {
-    std::uint8_t amount = parse_u8();
+    std::uint64_t amount = parse_len();
     std::stringstream out;
     out << "[";
-    for (uint8_t i; i < amount; ++i) {
+    for (std::uint64_t i = 0; i < amount; ++i) {
         out << parse_level_idx();
         if (i + 1 < amount) {
             out << ", ";
@@ -102,10 +115,10 @@ std::string BinPrinter::parse_levels() {
 }
 
 std::string BinPrinter::parse_names() {
-    std::uint8_t amount = parse_u8();
+    std::uint64_t amount = parse_len();
     std::stringstream out;
     out << "[";
-    for (uint8_t i; i < amount; ++i) {
+    for (std::uint64_t i = 0; i < amount; ++i) {
         out << parse_name_idx(true);
         if (i + 1 < amount) {
             out << ", ";
@@ -117,16 +130,16 @@ std::string BinPrinter::parse_names() {
 
 std::vector<std::pair<std::string, lean::name>> BinPrinter::parse_name_vec() {
     std::vector<std::pair<std::string, lean::name>> result;
-    std::uint8_t amount = parse_u8();
-    for (uint8_t i = 0; i < amount; ++i) {
-        std::uint16_t idx = parse_u16() % names.size();
+    std::uint64_t amount = parse_len();
+    for (std::uint64_t i = 0; i < amount; ++i) {
+        std::uint64_t idx = parse_idx() % names.size();
         result.emplace_back(names[idx]);
     }
     return result;
 }
 
 std::string BinPrinter::parse_expr_idx() {
-    std::uint16_t idx = parse_u16();
+    std::uint64_t idx = parse_idx();
     if (idx >= numExprs) {
         dbgf("bad expr index\n");
     } 
@@ -143,8 +156,8 @@ std::string BinPrinter::parse_expr_idx() {
 std::string BinPrinter::parse_natlit() {
     std::stringstream result;
     result << "(decodeNatLit [";
-    std::uint8_t len = parse_u8();
-    for (std::uint8_t i = 0; i < len; ++i) {
+    std::uint64_t len = parse_len();
+    for (std::uint64_t i = 0; i < len; ++i) {
         std::uint8_t byte = parse_u8();
         result << (std::uint32_t)byte;
         if (i + 1 < len) {
@@ -157,8 +170,8 @@ std::string BinPrinter::parse_natlit() {
 
 std::string BinPrinter::parse_strlit() {
     std::string result = "\"";
-    std::uint8_t len = parse_u8();
-    for (std::uint8_t i = 0; i < len; ++i) {
+    std::uint64_t len = parse_len();
+    for (std::uint64_t i = 0; i < len; ++i) {
         std::uint8_t byte = parse_u8();
         char c = (char)byte;
         result.push_back(c);
@@ -176,7 +189,7 @@ std::string BinPrinter::parse_hint() {
             return ".abbrev";
         }
         case 2: {
-            std::uint32_t v = parse_u32();
+            std::uint32_t v = version == 1 ? parse_u32() : parse_uleb();
             std::stringstream out;
             out << "(.regular " << v << ")";
             return out.str();
@@ -233,10 +246,10 @@ void BinPrinter::parse_name() {
         }
         case 1: {
             std::string parent = parse_name_idx(true);
-            std::uint16_t comp = parse_u16();
+            std::uint64_t comp = parse_idx();
             std::cout << "def name_" << myIndex << " : Lean.Name := "
                 << ".num " << parent << " " << comp << std::endl;
-            lean::name n(parent, comp);
+            lean::name n(parent, lean::nat(comp));
             std::stringstream out;
             out << "name_" << myIndex;
             names.push_back({ out.str(), n });
@@ -287,7 +300,7 @@ void BinPrinter::parse_expression() {
     std::cout << "def expr_" << myIndex << " : Lean.Expr := ";
     switch (expressionType % 10) {
         case 0: { // Bound variable
-            std::uint64_t deBruijnIndex = parse_u16();
+            std::uint64_t deBruijnIndex = parse_idx();
             dbgf("Bound variable %d\n", deBruijnIndex);
             std::cout << ".bvar " << deBruijnIndex << std::endl;
             break;
@@ -334,7 +347,7 @@ void BinPrinter::parse_expression() {
         }
         case 7: { // Projection
             std::string typeName = parse_name_idx(false);
-            std::uint16_t fieldIndex = parse_u16();
+            std::uint64_t fieldIndex = parse_idx();
             std::string value = parse_expr_idx();
             std::cout << ".proj " << typeName << " " << fieldIndex << " " << value << std::endl;
             break;
@@ -423,7 +436,7 @@ void BinPrinter::parse_inductive() {
 }
 
 void BinPrinter::parse_inductive_family() {
-    std::uint16_t numParams = parse_u8();
+    std::uint64_t numParams = version == 1 ? parse_u8() : parse_uleb();
     std::vector<std::pair<std::string, lean::name>> inductiveNames = parse_name_vec();
     std::string universeParameters = parse_names();
     // std::cout << "Inductive family: " << numParams << " params, " << inductiveNames.size()
@@ -495,6 +508,7 @@ void BinPrinter::parse_line() {
 }
 
 void BinPrinter::handle_data(const std::uint8_t *buf, std::uint64_t len) {
+    version = read_bin_header(buf, len).version;
     cur = buf;
     remaining_len = len;
 
@@ -519,23 +533,10 @@ std::vector<std::string> read_strings() {
     return result;
 }
 
-// https://www.coniferproductions.com/posts/2022/10/25/reading-binary-files-cpp/
-std::vector<std::byte> readFileData(const std::string& name) {
-    std::filesystem::path inputFilePath{name};
-    auto length = std::filesystem::file_size(inputFilePath);
-    if (length == 0) {
-        return {};  // empty vector
-    }
-    std::vector<std::byte> buffer(length);
-    std::ifstream inputFile(name, std::ios_base::binary);
-    inputFile.read(reinterpret_cast<char*>(buffer.data()), length);
-    inputFile.close();
-    return buffer;
-}
-
-BinPrinter::BinPrinter(const std::vector<std::string> & _strings) :
+BinPrinter::BinPrinter(const StringPool & _strings) :
         cur(nullptr),
         remaining_len(0),
+        version(1),
         strings(_strings),
         numExprs(0),
         numLevels(1),
@@ -561,9 +562,9 @@ int main(int argc, char* argv[]) {
     lean_initialize();
     lean_io_mark_end_initialization();
 
-    std::vector<std::string> strings = read_strings();
-    std::vector<std::byte> data = readFileData(argv[1]);
+    StringPool strings(read_strings());
+    MappedFile data(argv[1]);
     
     BinPrinter p(strings);
-    p.handle_data((const uint8_t *)data.data(), data.size());
+    p.handle_data(data.data(), data.size());
 }
\ No newline at end of file
@@ -9,10 +9,13 @@ Author: Markus Himmel
 #include <string>
 #include <cstdint>
 #include "util/name_hash_map.h"
+#include "string_pool.h"
+#include "binformat.h"
 
 class BinPrinter {
 public:
-    BinPrinter(const std::vector<std::string> & strings);
+    // `strings` is borrowed and must outlive the printer.
+    BinPrinter(const StringPool & strings);
 
     void handle_data(const std::uint8_t *buf, std::uint64_t len);
 
@@ -22,6 +25,10 @@ private:
     std::uint8_t parse_u8();
     std::uint16_t parse_u16();
     std::uint32_t parse_u32();
+    std::uint64_t parse_uleb();
+    // See `BinParser`
+    std::uint64_t parse_idx();
+    std::uint64_t parse_len();
     std::string parse_string();
 
     /* Parsing of lean-specific objects */
@@ -59,8 +66,9 @@ private:
 
     const std::uint8_t * cur;
     std::uint64_t remaining_len;
+    unsigned version;
     
-    std::vector<std::string> strings;
+    const StringPool & strings;
     
     size_t numExprs;
     size_t numLevels;
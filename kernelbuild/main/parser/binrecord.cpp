@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "binrecord.h"
+
+bool bin_record::defines(bin_table & table) const {
+    switch (kind) {
+        case bin_record_kind::Level: table = bin_table::Level; return true;
+        case bin_record_kind::Expr:  table = bin_table::Expr;  return true;
+        case bin_record_kind::Name:  table = bin_table::Name;  return true;
+        default: return false;
+    }
+}
+
+std::uint32_t initial_table_size(bin_table table) {
+    return table == bin_table::Expr ? 0 : 1;
+}
+
+/* Follows the structure of `BinParser::parse_line`, recording bytes instead of building objects */
+class RecordReader {
+public:
+    RecordReader(const std::uint8_t * buf, size_t len) :
+            cur(buf),
+            remaining_len(len) {
+        for (size_t i = 0; i < num_bin_tables; ++i) {
+            sizes[i] = initial_table_size(static_cast<bin_table>(i));
+        }
+    }
+
+    bool done() const {
+        return remaining_len == 0;
+    }
+
+    bin_record read_record() {
+        rec = bin_record();
+        std::uint8_t declType = parse_u8();
+        rec.kind = static_cast<bin_record_kind>(declType % 8);
+        switch (rec.kind) {
+            case bin_record_kind::Level: {
+                std::uint8_t levelType = parse_u8();
+                switch (levelType % 4) {
+                    case 0: parse_ref(bin_table::Level); break;
+                    case 1:
+                    case 2: parse_ref(bin_table::Level); parse_ref(bin_table::Level); break;
+                    case 3: parse_ref(bin_table::Name); break;
+                }
+                break;
+            }
+            case bin_record_kind::Expr:
+                parse_expression();
+                break;
+            case bin_record_kind::Definition: {
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                std::uint8_t hintType = parse_u8();
+                if (hintType % 3 == 2) {
+                    parse_bytes(4);
+                }
+                parse_refs(bin_table::Name);
+                break;
+            }
+            case bin_record_kind::Theorem:
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                parse_refs(bin_table::Name);
+                break;
+            case bin_record_kind::Inductive:
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                parse_refs(bin_table::Name);
+                break;
+            case bin_record_kind::InductiveFamily:
+                parse_u8();
+                parse_refs(bin_table::Name);
+                parse_refs(bin_table::Name);
+                break;
+            case bin_record_kind::Constructor:
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                break;
+            case bin_record_kind::Name:
+                parse_u8();
+                parse_ref(bin_table::Name);
+                // String index (into `strings`) or numeric component
+                parse_bytes(2);
+                break;
+        }
+        bin_table table;
+        if (rec.defines(table)) {
+            sizes[static_cast<size_t>(table)]++;
+        }
+        return rec;
+    }
+
+private:
+    std::uint8_t parse_u8() {
+        std::uint8_t result = 0;
+        if (remaining_len > 0) {
+            result = *cur;
+            ++cur;
+            --remaining_len;
+        }
+        rec.bytes.push_back(result);
+        return result;
+    }
+
+    void parse_bytes(size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            parse_u8();
+        }
+    }
+
+    std::uint16_t parse_u16() {
+        std::uint16_t high = parse_u8();
+        std::uint16_t low = parse_u8();
+        return (high << 8) | low;
+    }
+
+    void parse_ref(bin_table table) {
+        std::uint32_t offset = rec.bytes.size();
+        std::uint16_t idx = parse_u16();
+        std::uint32_t size = sizes[static_cast<size_t>(table)];
+        // An expression reference without any expressions means `Prop`, and stays that way
+        rec.refs.push_back({ offset, table, size > 0 ? idx % size : 0 });
+    }
+
+    void parse_refs(bin_table table) {
+        std::uint8_t amt = parse_u8();
+        for (std::uint8_t i = 0; i < amt; ++i) {
+            parse_ref(table);
+        }
+    }
+
+    void parse_expression() {
+        std::uint8_t expressionType = parse_u8();
+        switch (expressionType % 10) {
+            case 0: parse_bytes(2); break;                // bvar: de Bruijn index
+            case 1: parse_ref(bin_table::Level); break;   // sort
+            case 2:                                       // const
+                parse_ref(bin_table::Name);
+                parse_refs(bin_table::Level);
+                break;
+            case 3:                                       // app
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                break;
+            case 4:                                       // lambda
+            case 5:                                       // pi
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                break;
+            case 6:                                       // let
+                parse_ref(bin_table::Name);
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                parse_ref(bin_table::Expr);
+                break;
+            case 7:                                       // proj
+                parse_ref(bin_table::Name);
+                parse_bytes(2);
+                parse_ref(bin_table::Expr);
+                break;
+            case 8:                                       // nat literal
+            case 9:                                       // string literal
+                parse_bytes(parse_u8());
+                break;
+        }
+    }
+
+    const std::uint8_t * cur;
+    size_t remaining_len;
+    std::uint32_t sizes[num_bin_tables];
+    bin_record rec;
+};
+
+std::vector<bin_record> decode_records(const std::uint8_t * buf, size_t len) {
+    std::vector<bin_record> records;
+    RecordReader reader(buf, len);
+    while (!reader.done()) {
+        records.push_back(reader.read_record());
+    }
+    return records;
+}
+
+std::vector<std::uint8_t> encode_records(std::vector<bin_record> const & records) {
+    std::vector<std::uint8_t> result;
+    for (bin_record const & rec : records) {
+        size_t start = result.size();
+        result.insert(result.end(), rec.bytes.begin(), rec.bytes.end());
+        for (bin_ref const & ref : rec.refs) {
+            result[start + ref.offset] = static_cast<std::uint8_t>(ref.index >> 8);
+            result[start + ref.offset + 1] = static_cast<std::uint8_t>(ref.index);
+        }
+    }
+    return result;
+}
+
+std::vector<bin_record> select_records(std::vector<bin_record> const & records, std::vector<bool> const & keep) {
+    // For every table, the new index of every entry; entries of removed records map to 0
+    std::vector<std::uint32_t> new_index[num_bin_tables];
+    std::uint32_t sizes[num_bin_tables];
+    for (size_t i = 0; i < num_bin_tables; ++i) {
+        sizes[i] = initial_table_size(static_cast<bin_table>(i));
+        for (std::uint32_t j = 0; j < sizes[i]; ++j) {
+            new_index[i].push_back(j);
+        }
+    }
+
+    std::vector<bin_record> result;
+    for (size_t r = 0; r < records.size(); ++r) {
+        bin_table table;
+        bool defines = records[r].defines(table);
+        if (!keep[r]) {
+            if (defines) {
+                new_index[static_cast<size_t>(table)].push_back(0);
+            }
+            continue;
+        }
+        bin_record rec = records[r];
+        for (bin_ref & ref : rec.refs) {
+            std::vector<std::uint32_t> const & map = new_index[static_cast<size_t>(ref.table)];
+            ref.index = ref.index < map.size() ? map[ref.index] : 0;
+        }
+        if (defines) {
+            size_t t = static_cast<size_t>(table);
+            new_index[t].push_back(sizes[t]++);
+        }
+        result.push_back(std::move(rec));
+    }
+    return result;
+}
@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Record-level view of the binary export format.
+
+   `BinParser` turns a testcase into Lean objects. This splits it into its records instead (one
+   per `parse_line`), and knows which of their bytes are back-references into the level, expression
+   and name tables. That is what tools which edit testcases structurally (minimizer, mutators) need:
+   after removing a record, the references of all later records can be renumbered, so that they
+   keep pointing to the same entries.
+
+   Decoding mirrors `BinParser` exactly: references are resolved modulo the size of the table at
+   that point, and a truncated last record is padded with the zeros `BinParser` would read. So
+   `encode_records(decode_records(data))` parses to the same declarations as `data`.
+
+   This is version 1 of the format only (see `binformat.h`), which is what the fuzzers work on. */
+
+// The same numbering as the record type byte (modulo 8) in the binary format
+enum class bin_record_kind : std::uint8_t {
+    Level = 0,
+    Expr = 1,
+    Definition = 2,
+    Theorem = 3,
+    Inductive = 4,
+    InductiveFamily = 5,
+    Constructor = 6,
+    Name = 7,
+};
+
+// The tables a record can refer to. String indices point into the fixed `strings` file and are
+// not references in this sense.
+enum class bin_table : std::uint8_t {
+    Level,
+    Expr,
+    Name,
+};
+
+constexpr size_t num_bin_tables = 3;
+
+struct bin_ref {
+    // Offset of the big-endian u16 index in `bin_record::bytes`
+    std::uint32_t offset;
+    bin_table table;
+    // Index into the table, already reduced modulo the table size
+    std::uint32_t index;
+};
+
+struct bin_record {
+    bin_record_kind kind;
+    // The encoded record, starting with the type byte
+    std::vector<std::uint8_t> bytes;
+    std::vector<bin_ref> refs;
+
+    // Returns true and sets `table` if the record appends an entry to a table
+    bool defines(bin_table & table) const;
+};
+
+// Number of entries the tables start out with: the anonymous name and level zero
+std::uint32_t initial_table_size(bin_table table);
+
+std::vector<bin_record> decode_records(const std::uint8_t * buf, size_t len);
+
+// Writes the references of every record back into its bytes, and concatenates them
+std::vector<std::uint8_t> encode_records(std::vector<bin_record> const & records);
+
+// Keeps the records for which `keep` is true. References to entries of removed records are
+// redirected to the first entry of the same table, and all others are renumbered.
+std::vector<bin_record> select_records(std::vector<bin_record> const & records, std::vector<bool> const & keep);
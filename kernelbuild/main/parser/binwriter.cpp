@@ -0,0 +1,435 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "binwriter.h"
+#include "binformat.h"
+#include "runtime/exception.h"
+
+/* Record type bytes, see `BinParser::parse_line` */
+static constexpr std::uint8_t record_level = 0;
+static constexpr std::uint8_t record_expr = 1;
+static constexpr std::uint8_t record_definition = 2;
+static constexpr std::uint8_t record_theorem = 3;
+static constexpr std::uint8_t record_inductive = 4;
+static constexpr std::uint8_t record_inductive_family = 5;
+static constexpr std::uint8_t record_constructor = 6;
+static constexpr std::uint8_t record_name = 7;
+
+void BinWriter::push_u8(std::uint8_t v) {
+    data.push_back(v);
+}
+
+void BinWriter::push_u16(std::uint16_t v) {
+    push_u8(v >> 8);
+    push_u8(v & 0xff);
+}
+
+void BinWriter::push_u32(std::uint32_t v) {
+    push_u16(v >> 16);
+    push_u16(v & 0xffff);
+}
+
+void BinWriter::push_uleb(std::uint64_t v) {
+    write_uleb(data, v);
+}
+
+void BinWriter::push_idx(size_t idx, char const * what) {
+    if (version == 2) {
+        push_uleb(idx);
+        return;
+    }
+    if (idx > 0xffff) {
+        throw lean::exception(std::string("too many ") + what + " for the binary format");
+    }
+    push_u16(idx);
+}
+
+void BinWriter::push_number(const lean::nat & n, char const * what) {
+    if (!n.is_small() || (version == 1 && n.get_small_value() > 0xffff)) {
+        throw lean::exception(std::string(what) + " too large for the binary format");
+    }
+    if (version == 2) {
+        push_uleb(n.get_small_value());
+    } else {
+        push_u16(n.get_small_value());
+    }
+}
+
+void BinWriter::push_length(size_t len, char const * what) {
+    if (version == 2) {
+        push_uleb(len);
+        return;
+    }
+    if (len > 0xff) {
+        throw lean::exception(std::string("too many ") + what + " in a list for the binary format");
+    }
+    push_u8(len);
+}
+
+void BinWriter::push_idxs(const std::vector<unsigned> & idxs, char const * what) {
+    push_length(idxs.size(), what);
+    for (unsigned idx : idxs) {
+        push_idx(idx, what);
+    }
+}
+
+unsigned BinWriter::string_idx(const std::string & s) {
+    auto it = string_map.find(s);
+    if (it != string_map.end()) {
+        return it->second;
+    }
+    unsigned idx = strings.size();
+    strings.push_back(s);
+    string_map.insert({ s, idx });
+    ++new_strings;
+    return idx;
+}
+
+unsigned BinWriter::dump_name(const lean::name & n) {
+    auto it = names.find(n);
+    if (it != names.end()) {
+        return it->second;
+    }
+    unsigned parent = dump_name(n.get_prefix());
+    if (n.is_string()) {
+        unsigned comp = string_idx(n.get_string().to_std_string());
+        push_u8(record_name);
+        push_u8(0);
+        push_idx(parent, "names");
+        push_idx(comp, "strings");
+    } else {
+        push_u8(record_name);
+        push_u8(1);
+        push_idx(parent, "names");
+        push_number(n.get_numeral(), "numeric name component");
+    }
+    unsigned idx = names.size();
+    names.insert({ n, idx });
+    return idx;
+}
+
+unsigned BinWriter::dump_level(const lean::level & l) {
+    auto it = levels.find(l);
+    if (it != levels.end()) {
+        return it->second;
+    }
+    switch (l.kind()) {
+        case lean::level_kind::Succ: {
+            unsigned parent = dump_level(succ_of(l));
+            push_u8(record_level);
+            push_u8(0);
+            push_idx(parent, "levels");
+            break;
+        }
+        case lean::level_kind::Max:
+        case lean::level_kind::IMax: {
+            bool is_max = l.is_max();
+            unsigned lhs = dump_level(is_max ? max_lhs(l) : imax_lhs(l));
+            unsigned rhs = dump_level(is_max ? max_rhs(l) : imax_rhs(l));
+            push_u8(record_level);
+            push_u8(is_max ? 1 : 2);
+            push_idx(lhs, "levels");
+            push_idx(rhs, "levels");
+            break;
+        }
+        case lean::level_kind::Param: {
+            unsigned n = dump_name(param_id(l));
+            push_u8(record_level);
+            push_u8(3);
+            push_idx(n, "names");
+            break;
+        }
+        case lean::level_kind::Zero:
+        case lean::level_kind::MVar:
+            throw lean::exception("unexpected level in declaration");
+    }
+    unsigned idx = levels.size();
+    levels.insert({ l, idx });
+    return idx;
+}
+
+std::vector<unsigned> BinWriter::dump_names(const lean::names & ns) {
+    std::vector<unsigned> result;
+    for (const lean::name & n : ns) {
+        result.push_back(dump_name(n));
+    }
+    return result;
+}
+
+std::vector<unsigned> BinWriter::dump_levels(const lean::levels & ls) {
+    std::vector<unsigned> result;
+    for (const lean::level & l : ls) {
+        result.push_back(dump_level(l));
+    }
+    return result;
+}
+
+void BinWriter::dump_natlit(const lean::nat & n) {
+    // Big-endian bytes without leading zeros, see `BinParser::parse_natlit`
+    std::vector<std::uint8_t> bytes;
+    lean::mpz v = n.to_mpz();
+    while (!v.is_zero()) {
+        bytes.push_back(v.mod8());
+        v /= 256u;
+    }
+    push_length(bytes.size(), "bytes");
+    for (auto it = bytes.rbegin(); it != bytes.rend(); ++it) {
+        push_u8(*it);
+    }
+}
+
+unsigned BinWriter::dump_expr(const lean::expr & e) {
+    auto it = exprs.find(e);
+    if (it != exprs.end()) {
+        return it->second;
+    }
+    // Subterms come first, the names and levels of the node itself after them
+    switch (e.kind()) {
+        case lean::expr_kind::BVar: {
+            push_u8(record_expr);
+            push_u8(0);
+            push_number(bvar_idx(e), "de Bruijn index");
+            break;
+        }
+        case lean::expr_kind::Sort: {
+            unsigned l = dump_level(sort_level(e));
+            push_u8(record_expr);
+            push_u8(1);
+            push_idx(l, "levels");
+            break;
+        }
+        case lean::expr_kind::Const: {
+            unsigned n = dump_name(const_name(e));
+            std::vector<unsigned> ls = dump_levels(const_levels(e));
+            push_u8(record_expr);
+            push_u8(2);
+            push_idx(n, "names");
+            push_idxs(ls, "levels");
+            break;
+        }
+        case lean::expr_kind::App: {
+            unsigned fn = dump_expr(app_fn(e));
+            unsigned arg = dump_expr(app_arg(e));
+            push_u8(record_expr);
+            push_u8(3);
+            push_idx(fn, "expressions");
+            push_idx(arg, "expressions");
+            break;
+        }
+        case lean::expr_kind::Lambda:
+        case lean::expr_kind::Pi: {
+            unsigned domain = dump_expr(binding_domain(e));
+            unsigned body = dump_expr(binding_body(e));
+            unsigned n = dump_name(binding_name(e));
+            push_u8(record_expr);
+            push_u8(is_lambda(e) ? 4 : 5);
+            push_idx(n, "names");
+            push_idx(domain, "expressions");
+            push_idx(body, "expressions");
+            break;
+        }
+        case lean::expr_kind::Let: {
+            unsigned type = dump_expr(let_type(e));
+            unsigned value = dump_expr(let_value(e));
+            unsigned body = dump_expr(let_body(e));
+            unsigned n = dump_name(let_name(e));
+            push_u8(record_expr);
+            push_u8(6);
+            push_idx(n, "names");
+            push_idx(type, "expressions");
+            push_idx(value, "expressions");
+            push_idx(body, "expressions");
+            break;
+        }
+        case lean::expr_kind::Proj: {
+            unsigned value = dump_expr(proj_expr(e));
+            unsigned n = dump_name(proj_sname(e));
+            push_u8(record_expr);
+            push_u8(7);
+            push_idx(n, "names");
+            push_number(proj_idx(e), "projection index");
+            push_idx(value, "expressions");
+            break;
+        }
+        case lean::expr_kind::Lit: {
+            const lean::literal & lit = lit_value(e);
+            push_u8(record_expr);
+            if (lit.kind() == lean::literal_kind::Nat) {
+                push_u8(8);
+                dump_natlit(lit.get_nat());
+            } else {
+                std::string s = lit.get_string().to_std_string();
+                push_u8(9);
+                push_length(s.size(), "bytes");
+                for (char c : s) {
+                    push_u8(static_cast<std::uint8_t>(c));
+                }
+            }
+            break;
+        }
+        case lean::expr_kind::FVar:
+        case lean::expr_kind::MVar:
+        case lean::expr_kind::MData:
+            throw lean::exception("unexpected expression in declaration");
+    }
+    unsigned idx = exprs.size();
+    exprs.insert({ e, idx });
+    return idx;
+}
+
+void BinWriter::dump_hint(const lean::reducibility_hints & hint) {
+    switch (hint.kind()) {
+        case lean::reducibility_hints_kind::Opaque:
+            push_u8(0);
+            break;
+        case lean::reducibility_hints_kind::Abbreviation:
+            push_u8(1);
+            break;
+        case lean::reducibility_hints_kind::Regular:
+            push_u8(2);
+            if (version == 2) {
+                push_uleb(hint.get_height());
+            } else {
+                push_u32(hint.get_height());
+            }
+            break;
+    }
+}
+
+void BinWriter::dump_definition(const lean::definition_val & val) {
+    unsigned type = dump_expr(val.get_type());
+    unsigned value = dump_expr(val.get_value());
+    unsigned n = dump_name(val.get_name());
+    std::vector<unsigned> lparams = dump_names(val.get_lparams());
+
+    push_u8(record_definition);
+    push_idx(n, "names");
+    push_idx(type, "expressions");
+    push_idx(value, "expressions");
+    dump_hint(val.get_hints());
+    push_idxs(lparams, "universe parameters");
+    ++num_decls;
+}
+
+void BinWriter::dump_theorem(const lean::theorem_val & val) {
+    unsigned type = dump_expr(val.get_type());
+    unsigned value = dump_expr(val.get_value());
+    unsigned n = dump_name(val.get_name());
+    std::vector<unsigned> lparams = dump_names(val.get_lparams());
+
+    push_u8(record_theorem);
+    push_idx(n, "names");
+    push_idx(type, "expressions");
+    push_idx(value, "expressions");
+    push_idxs(lparams, "universe parameters");
+    ++num_decls;
+}
+
+void BinWriter::dump_inductive_decl(const lean::inductive_decl & decl) {
+    const lean::nat & num_params = decl.get_nparams();
+    if (!num_params.is_small() || (version == 1 && num_params.get_small_value() > 0xff)) {
+        throw lean::exception("too many parameters for the binary format");
+    }
+
+    std::vector<unsigned> inductive_names;
+    for (const lean::inductive_type & ind : decl.get_types()) {
+        std::vector<unsigned> constructor_names;
+        for (const lean::constructor & c : ind.get_cnstrs()) {
+            unsigned type = dump_expr(constructor_type(c));
+            unsigned n = dump_name(constructor_name(c));
+            push_u8(record_constructor);
+            push_idx(n, "names");
+            push_idx(type, "expressions");
+            constructor_names.push_back(n);
+        }
+
+        unsigned type = dump_expr(ind.get_type());
+        unsigned n = dump_name(ind.get_name());
+        push_u8(record_inductive);
+        push_idx(n, "names");
+        push_idx(type, "expressions");
+        push_idxs(constructor_names, "constructors");
+        inductive_names.push_back(n);
+    }
+    std::vector<unsigned> lparams = dump_names(decl.get_lparams());
+
+    push_u8(record_inductive_family);
+    if (version == 2) {
+        push_uleb(num_params.get_small_value());
+    } else {
+        push_u8(num_params.get_small_value());
+    }
+    push_idxs(inductive_names, "inductive types");
+    push_idxs(lparams, "universe parameters");
+    ++num_decls;
+}
+
+bool BinWriter::add_declaration(const lean::declaration & d) {
+    switch (d.kind()) {
+        case lean::declaration_kind::Definition:
+            // The format has no field for the safety, so `BinParser` would read them back as safe
+            if (d.to_definition_val().get_safety() != lean::definition_safety::safe) {
+                return false;
+            }
+            dump_definition(d.to_definition_val());
+            return true;
+        case lean::declaration_kind::Theorem:
+            dump_theorem(d.to_theorem_val());
+            return true;
+        case lean::declaration_kind::Inductive:
+            // Likewise
+            if (lean::inductive_decl(d).is_unsafe()) {
+                return false;
+            }
+            dump_inductive_decl(lean::inductive_decl(d));
+            return true;
+        case lean::declaration_kind::Axiom:
+        case lean::declaration_kind::Opaque:
+        case lean::declaration_kind::Quot:
+        case lean::declaration_kind::MutualDefinition:
+            return false;
+    }
+    return false;
+}
+
+std::vector<std::uint8_t> BinWriter::get_data() const {
+    if (version == 1) {
+        return data;
+    }
+    // The tables start out with the anonymous name and level zero, which have no records
+    bin_header header;
+    header.num_names = names.size() - 1;
+    header.num_levels = levels.size() - 1;
+    header.num_exprs = exprs.size();
+    header.num_decls = num_decls;
+    std::vector<std::uint8_t> result;
+    result.reserve(data.size() + 32);
+    write_bin_header(result, header);
+    result.insert(result.end(), data.begin(), data.end());
+    return result;
+}
+
+size_t BinWriter::get_new_strings() const {
+    return new_strings;
+}
+
+BinWriter::BinWriter(std::vector<std::string> & _strings, unsigned _version) :
+        version(_version),
+        data(),
+        num_decls(0),
+        strings(_strings),
+        string_map(),
+        new_strings(0),
+        names(),
+        levels(),
+        exprs() {
+    // Later entries win, like `computeStringMap` in `Export/Binary.lean`
+    for (size_t i = 0; i < strings.size(); ++i) {
+        string_map[strings[i]] = i;
+    }
+    names.insert({ lean::name::anonymous(), 0 });
+    levels.insert({ lean::mk_level_zero(), 0 });
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "kernel/declaration.h"
+#include "kernel/expr_maps.h"
+#include "util/name_hash_map.h"
+
+/* Writes declarations in the binary format that `BinParser` reads.
+
+   This is `Export/Binary.lean` in C++: names, levels and expressions are written once, the first
+   time a declaration refers to them, and are deduplicated structurally. Given the same declarations
+   in the same order and the same string table, the output is equivalent to what the Lean exporter
+   writes after parsing: `BinParser` reads back the same declarations. It is not the same bytes,
+   since the records of the tables can come in a different order. For example, the exporter writes
+   the names of the recursors a declaration refers to before its type, and this writer at the
+   first constant that refers to them.
+
+   String components of names are looked up in `strings`. Components that are missing are appended
+   to it, so testcases written against the old table stay valid with the new one.
+
+   Both versions of the format can be written (see `binformat.h`). Version 1 is what the corpus
+   uses; version 2 has no limits on table sizes and starts with a header giving them. */
+class BinWriter {
+public:
+    // `strings` is borrowed and must outlive the writer. `version` is 1 or 2.
+    BinWriter(std::vector<std::string> & strings, unsigned version = 1);
+
+    // Returns false if the binary format has no record for `d` (axioms, opaque definitions, `Quot`
+    // and mutual definitions), or if the exporter skips it (unsafe and partial definitions, unsafe
+    // inductive types), in which case nothing is written. Throws `lean::exception` if a
+    // table, list, literal or number outgrows what the format can encode, which for version 2
+    // only happens for numbers beyond 64 bits.
+    bool add_declaration(const lean::declaration & d);
+
+    // The file so far, with the header for version 2
+    std::vector<std::uint8_t> get_data() const;
+
+    // Number of strings appended to the table so far
+    size_t get_new_strings() const;
+
+private:
+    /* Basic writing functions */
+    void push_u8(std::uint8_t v);
+    void push_u16(std::uint16_t v);
+    void push_u32(std::uint32_t v);
+    void push_uleb(std::uint64_t v);
+    // An index into a table or into `strings`: u16 in version 1, a varint in version 2
+    void push_idx(size_t idx, char const * what);
+    // A number in a record (de Bruijn index, projection index, numeric name component), like an index
+    void push_number(const lean::nat & n, char const * what);
+    // The length of a list or literal: u8 in version 1, a varint in version 2
+    void push_length(size_t len, char const * what);
+    void push_idxs(const std::vector<unsigned> & idxs, char const * what);
+    unsigned string_idx(const std::string & s);
+
+    /* Writing of lean-specific objects, returning the index in the table */
+    unsigned dump_name(const lean::name & n);
+    unsigned dump_level(const lean::level & l);
+    unsigned dump_expr(const lean::expr & e);
+    std::vector<unsigned> dump_names(const lean::names & ns);
+    std::vector<unsigned> dump_levels(const lean::levels & ls);
+    void dump_natlit(const lean::nat & n);
+    void dump_hint(const lean::reducibility_hints & hint);
+
+    /* Writing of specific constructions */
+    void dump_definition(const lean::definition_val & val);
+    void dump_theorem(const lean::theorem_val & val);
+    void dump_inductive_decl(const lean::inductive_decl & decl);
+
+    /* Data members */
+
+    unsigned version;
+    std::vector<std::uint8_t> data;
+    // Definitions, theorems and inductive families, for the header
+    size_t num_decls;
+
+    std::vector<std::string> & strings;
+    std::unordered_map<std::string, unsigned> string_map;
+    size_t new_strings;
+
+    lean::name_hash_map<unsigned> names;
+    std::unordered_map<lean::level, unsigned, lean::level_hash> levels;
+    lean::expr_map<unsigned> exprs;
+};
@@ -6,24 +6,24 @@ Author: Markus Himmel
 */
 #include "parser.h"
 #include "binparser.h"
+#include "snapshot.h"
+#include "procstat.h"
+#include "iteration_heap.h"
+#include "harness.h"
+#include "batch.h"
+#include "minimize.h"
+#include "triage.h"
+#include "generator.h"
+#include "rule_feedback.h"
+#include "startup_profile.h"
 #include "kernel/environment.h"
-#include "kernel/kernel_exception.h"
-#include "kernel/init_module.h"
 #include "library/elab_environment.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <optional>
 #include <unistd.h>
-#include <filesystem>
-
-extern "C" void lean_initialize_runtime_module();
-extern "C" void lean_initialize();
-extern "C" void lean_io_mark_end_initialization();
-// extern "C" lean_object * initialize_Lean_Environment(uint8_t builtin, lean_object *);
-
-extern "C" lean_object* lean_mk_empty_environment(uint32_t trust_level, lean_object* /* world */);
-extern "C" lean_object* lean_elab_environment_to_kernel_env(lean_object* x_1);
 
 #ifdef __AFL_FUZZ_TESTCASE_LEN
 
@@ -31,62 +31,117 @@ __AFL_FUZZ_INIT();
 
 #endif
 
-std::vector<std::string> read_strings() {
-    std::ifstream stream("strings");
-    std::stringstream buffer;
-    buffer << stream.rdbuf();
-    std::vector<std::string> result;
-    std::string s;
-    while (std::getline(buffer, s, '\n')) {
-        result.push_back(s);
-    }
-    return result;
-}
+int main(int argc, char* argv[]) {
+    initialize_runtime();
 
-// https://www.coniferproductions.com/posts/2022/10/25/reading-binary-files-cpp/
-std::vector<std::byte> readFileData(const std::string& name) {
-    std::filesystem::path inputFilePath{name};
-    auto length = std::filesystem::file_size(inputFilePath);
-    if (length == 0) {
-        return {};  // empty vector
+    std::string save_snapshot_fname;
+    std::string load_snapshot_fname;
+    check_budget budget;
+    bool batch = false;
+    bool minimize = false;
+    bool triage = false;
+    bool generate = false;
+    std::string output_fname;
+    batch_options batch_opts;
+    triage_options triage_opts;
+    generator_options generator_opts;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (int consumed = budget.parse_arg(argc, argv, i)) {
+            i += consumed - 1;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            batch_opts.jobs = triage_opts.jobs = generator_opts.jobs = std::stoul(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            batch_opts.format = argv[++i];
+        } else if (arg == "--minimize") {
+            minimize = true;
+        } else if (arg == "--triage") {
+            triage = true;
+        } else if (arg == "--stack-depth" && i + 1 < argc) {
+            triage_opts.stack_depth = std::stoul(argv[++i]);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            triage_opts.timeout = std::stoul(argv[++i]);
+        } else if (arg == "--generate" && i + 1 < argc) {
+            generate = true;
+            generator_opts.count = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            generator_opts.seed = std::stoull(argv[++i]);
+        } else if (arg == "--max-decls" && i + 1 < argc) {
+            generator_opts.max_decls = std::stoul(argv[++i]);
+        } else if (arg == "--depth" && i + 1 < argc) {
+            generator_opts.max_depth = std::stoul(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_fname = argv[++i];
+        } else if (arg == "--save-snapshot" && i + 1 < argc) {
+            save_snapshot_fname = argv[++i];
+        } else if (arg == "--load-snapshot" && i + 1 < argc) {
+            load_snapshot_fname = argv[++i];
+        } else {
+            args.push_back(arg);
+        }
     }
-    std::vector<std::byte> buffer(length);
-    std::ifstream inputFile(name, std::ios_base::binary);
-    inputFile.read(reinterpret_cast<char*>(buffer.data()), length);
-    inputFile.close();
-    return buffer;
-}
 
-int main(int argc, char* argv[]) {
-    lean_initialize_runtime_module();
-    lean_initialize();
-    lean_io_mark_end_initialization();
+    // Checked before the prelude is loaded, which takes a while
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+    bool needs_input = minimize;
+#else
+    bool needs_input = minimize || !(batch || triage || generate || !save_snapshot_fname.empty());
+#endif
+    if (needs_input && args.empty()) {
+        std::cout << "Usage: " << argv[0] << " [--minimize [--output FILE]] TESTCASE" << std::endl;
+        return setup_error_exit_code;
+    }
 
-    std::vector<std::string> strings = read_strings();
-    
-    std::ifstream stream("prelude.elean");
-    std::stringstream buffer;
-    buffer << stream.rdbuf();
+    StringPool strings(read_strings());
     
-    Parser p(true);
-    p.handle_file(buffer.str());
+    MappedFile prelude = read_prelude();
+    lean::optional<lean::elab_environment> prelude_env = load_prelude(prelude.text(), load_snapshot_fname);
+    if (!prelude_env) {
+        return setup_error_exit_code;
+    }
+    lean::elab_environment elab_env = *prelude_env;
+    report_mem_stats(snapshot_is_shared() ? "prelude (shared snapshot)" : "prelude (private)");
+    print_startup_profile();
 
-    if (p.is_error()) {
-        return 1;
+    if (!save_snapshot_fname.empty()) {
+        try {
+            save_snapshot(save_snapshot_fname, elab_env, prelude_hash(prelude.text()));
+        } catch (const lean::exception &ex) {
+            std::cout << ex.what() << std::endl;
+            return setup_error_exit_code;
+        }
+        return 0;
     }
-    
-    lean_object *io_ress = lean_mk_empty_environment(0, lean_io_mk_world());
-    lean_inc(io_ress);
-    lean_object *eenv = lean_io_result_get_value(io_ress);
 
-    lean::elab_environment elab_env(eenv, true);
-    
-    try {
-        for (const lean::declaration & d : p.get_decls()) {
-          elab_env = elab_env.add(d);
+    // Testcases are added to the kernel environment directly, see `check_testcase`
+    lean::environment kernel_env = elab_env.to_kernel_env();
+
+    if (triage) {
+        if (!output_fname.empty()) {
+            triage_opts.output_dir = output_fname;
         }
-    } catch (const lean::unknown_constant_exception &ex) {
-        std::cout << "Unkown constant: " << ex.get_name() << std::endl;
+        return run_triage(collect_crashes(args), strings, kernel_env, budget, triage_opts);
+    }
+
+    if (batch || minimize || generate) {
+        // Testcases are checked in an `IterationHeap`, see below
+        if (!lean_is_persistent(kernel_env.raw())) {
+            std::cout << "Prelude environment is not persistent" << std::endl;
+            return setup_error_exit_code;
+        }
+        if (generate) {
+            generator_opts.output_dir = output_fname;
+            return run_generate(strings, kernel_env, budget, generator_opts);
+        }
+        if (minimize) {
+            return run_minimize(args[0], output_fname, strings, kernel_env, budget);
+        }
+        batch_opts.output = output_fname;
+        batch_opts.share_terms = term_sharing_enabled();
+        return run_batch(collect_inputs(args), strings, kernel_env, budget, batch_opts);
     }
     
 #ifdef __AFL_FUZZ_TESTCASE_LEN
@@ -97,65 +152,97 @@ int main(int argc, char* argv[]) {
 
     unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;
 
+    // Everything an iteration allocates lives in an `IterationHeap`, which requires the prelude
+    // environment to be persistent, with its thunks forced (see `check_prelude`). Set
+    // `FUZZ_CHECK_ESCAPES` to verify after every iteration that nothing from the heap became
+    // reachable from it anyway.
+    if (!lean_is_persistent(kernel_env.raw())) {
+        std::cout << "Prelude environment is not persistent" << std::endl;
+        return setup_error_exit_code;
+    }
+    bool check_heap_escapes = getenv("FUZZ_CHECK_ESCAPES") != nullptr;
+
+    // Set `FUZZ_KERNEL_RULES` to report the kernel rules every testcase applied as extra coverage
+    static unsigned char rule_map[lean::kernel_rule_map_size];
+    std::optional<lean::scope_kernel_rule_map> rule_scope;
+    if (kernel_rules_enabled()) {
+        rule_scope.emplace(rule_map);
+    }
+
+    // Set `FUZZ_SHARE_TERMS` to hash-cons testcases while parsing them, see `expr_sharing.h`
+    bool share_terms = term_sharing_enabled();
+
+    size_t outcome_counts[num_check_outcomes] = {};
+
     while (__AFL_LOOP(10000)) {
         unsigned long len = __AFL_FUZZ_TESTCASE_LEN;
 
-        BinParser p2(strings);
-        p2.handle_data((const uint8_t *)buf, len);
-        
-        lean::elab_environment loop_env(elab_env);
-
-        bool kernel_error = false;
-        bool added_false = p2.add_false();
-        try {
-            for (const lean::declaration & d : p2.get_decls()) {
-                loop_env = loop_env.add(d);
-            }
-        } catch (...) {
-            // Did not succeed
-            kernel_error = true;
+        check_outcome outcome = check_in_iteration_heap((const uint8_t *)buf, len, strings, kernel_env, budget, share_terms);
+        outcome_counts[static_cast<size_t>(outcome)]++;
+        if (rule_scope) {
+            feed_kernel_rules_to_afl(rule_map);
         }
         
-        if (added_false && !kernel_error) {
+        if (outcome == check_outcome::proof_of_false) {
             std::cout << "Have a proof of false?!" << std::endl;
             abort();
         }
 
+        if (check_heap_escapes) {
+            check_escapes(kernel_env.raw());
+        }
     }
+    for (size_t i = 0; i < num_check_outcomes; ++i) {
+        std::cout << outcome_name(static_cast<check_outcome>(i)) << ": " << outcome_counts[i] << std::endl;
+    }
+    report_mem_stats("after fuzzing loop");
 #else
  
     bool binary = true;
+    bool share_terms = term_sharing_enabled();
+    // Set `FUZZ_TABLE_LIVENESS` to release table entries of the binary parser after their last use.
+    // The statistics count entries; compare the peak RSS `FUZZ_REPORT_MEMORY` prints with and
+    // without it to see what that saves.
+    bool track_liveness = table_liveness_enabled();
 
     if (binary) {
-        std::vector<std::byte> data = readFileData(argv[1]);
+        MappedFile data(args[0]);
     
-        BinParser p2(strings);
-        p2.handle_data((const uint8_t *)data.data(), data.size());
+        // Large exports are parsed on a thread of their own while the kernel checks them
+        BinParser p2(strings, share_terms, track_liveness);
+        p2.start(data.data(), data.size());
     
-        lean::elab_environment loop_env(elab_env);
+        lean::environment loop_env(kernel_env);
+
+        unsigned char rule_map[lean::kernel_rule_map_size] = {};
+        std::optional<lean::scope_kernel_rule_map> rule_scope;
+        if (kernel_rules_enabled()) {
+            rule_scope.emplace(rule_map);
+        }
         
-        bool kernel_error = false;
-        bool added_false = p2.add_false();
-        try {
-            for (const lean::declaration & d : p2.get_decls()) {
-                loop_env = loop_env.add(d);
-            }
-        } catch (...) {
-            // Did not succeed
-            kernel_error = true;
+        check_outcome outcome = check_testcase_pipelined(loop_env, p2, budget);
+        std::cout << "Outcome: " << outcome_name(outcome) << std::endl;
+        if (share_terms) {
+            print_sharing_stats("Sharing", p2.get_sharing_stats());
+        }
+        if (track_liveness) {
+            print_liveness_stats("Liveness", p2.get_liveness_stats());
+        }
+        report_mem_stats("after checking");
+        if (rule_scope) {
+            print_kernel_rules(rule_map);
         }
         
-        if (added_false && !kernel_error) {
+        if (outcome == check_outcome::proof_of_false) {
             std::cout << "Have a proof of false?!" << std::endl;
             abort();
         }
+        return outcome_exit_code(outcome);
     } else {
-        std::ifstream stream2(argv[1]);
-        std::stringstream buffer2;
-        buffer2 << stream2.rdbuf();
+        MappedFile data(args[0]);
         
-        Parser p2(false);
-        p2.handle_file(buffer2.str());
+        Parser p2(false, 0, share_terms);
+        p2.handle_file(sz::string_view(data.text().data(), data.size()));
     
         if (p2.is_error()) {
             std::cout << "Parse error" << std::endl;
@@ -163,8 +250,11 @@ int main(int argc, char* argv[]) {
         }
         
         std::cout << "Finished parsing." << std::endl;
+        if (share_terms) {
+            print_sharing_stats("Sharing", p2.get_sharing_stats());
+        }
         
-        lean::elab_environment loop_env(elab_env);
+        lean::environment loop_env(kernel_env);
     
         // p2.add_false();
         for (const lean::declaration & d : p2.get_decls()) {
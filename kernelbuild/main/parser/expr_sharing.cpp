@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "expr_sharing.h"
+
+#include <cstdlib>
+#include <iostream>
+
+double sharing_stats::expr_ratio() const {
+    return exprs == 0 ? 0.0 : static_cast<double>(shared_exprs) / exprs;
+}
+
+lean::expr ExprSharing::share(lean::expr const & e) {
+    ++stats.exprs;
+    auto [it, inserted] = expr_table.insert(e);
+    if (!inserted) {
+        ++stats.shared_exprs;
+    }
+    return *it;
+}
+
+lean::level ExprSharing::share(lean::level const & l) {
+    ++stats.levels;
+    auto [it, inserted] = level_table.insert(l);
+    if (!inserted) {
+        ++stats.shared_levels;
+    }
+    return *it;
+}
+
+const sharing_stats & ExprSharing::get_stats() const {
+    return stats;
+}
+
+bool term_sharing_enabled() {
+    return getenv("FUZZ_SHARE_TERMS") != nullptr;
+}
+
+void print_sharing_stats(char const * what, sharing_stats const & stats) {
+    std::cout << what << ": " << stats.shared_exprs << " of " << stats.exprs << " expressions shared ("
+              << 100.0 * stats.expr_ratio() << "%), " << stats.shared_levels << " of " << stats.levels
+              << " levels shared" << std::endl;
+}
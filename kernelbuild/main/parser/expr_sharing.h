@@ -0,0 +1,56 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstddef>
+#include "kernel/expr.h"
+#include "kernel/expr_eq_fn.h"
+#include "kernel/level.h"
+#include "util/alloc.h"
+
+/* Hash-consing for the parsers.
+
+   Both export formats refer to subterms by index, but nothing stops an export from writing the
+   same term twice under different indices, and the parsers then build two objects for it. The
+   kernel only notices that they are equal by comparing them structurally: the `is_eqp` fast
+   paths in `expr_eq_fn` and the caches of `replace_rec_fn` and `type_checker` miss.
+
+   With sharing enabled, every level and expression a parser builds goes through `share`, which
+   returns the structurally equal object built earlier, if there is one. Parsers build terms
+   bottom-up from objects that went through `share` already, so a lookup compares children by
+   pointer and does not descend into them. This is what `lean::max_sharing_fn` computes for a
+   finished term, but its tables use `std::allocator`, which `IterationHeap` does not allow. */
+
+struct sharing_stats {
+    // Objects that went through `share`
+    size_t exprs = 0;
+    size_t levels = 0;
+    // How many of them were replaced by an earlier object
+    size_t shared_exprs = 0;
+    size_t shared_levels = 0;
+
+    // Share of the expressions that were replaced, between 0 and 1
+    double expr_ratio() const;
+};
+
+class ExprSharing {
+public:
+    lean::expr share(lean::expr const & e);
+    lean::level share(lean::level const & l);
+
+    const sharing_stats & get_stats() const;
+
+private:
+    lean::unordered_set<lean::expr, lean::expr_hash, lean::is_bi_equal_proc> expr_table;
+    lean::unordered_set<lean::level, lean::level_hash> level_table;
+    sharing_stats stats;
+};
+
+// True if the environment variable `FUZZ_SHARE_TERMS` is set
+bool term_sharing_enabled();
+
+// Prints `stats` on one line, prefixed with `what`
+void print_sharing_stats(char const * what, sharing_stats const & stats);
@@ -0,0 +1,495 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "generator.h"
+#include "binparser.h"
+#include "binwriter.h"
+#include "kernel/instantiate.h"
+#include "runtime/interrupt.h"
+#include "runtime/stackinfo.h"
+#include "runtime/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// Attempts before `term_of_type` gives up on a goal
+static constexpr unsigned max_candidates = 8;
+static constexpr unsigned max_heads = 3;
+static constexpr unsigned max_args = 12;
+
+// The head constant of the conclusion of `type`, if any. Heads are looked up by it.
+static lean::optional<lean::name> result_head(lean::expr type) {
+    while (lean::is_pi(type)) {
+        type = lean::binding_body(type);
+    }
+    const lean::expr & fn = lean::get_app_fn(type);
+    if (lean::is_constant(fn)) {
+        return lean::optional<lean::name>(lean::const_name(fn));
+    }
+    return lean::optional<lean::name>();
+}
+
+// `Prop` or `Type`, the sorts generated inductives can have fields in
+static bool is_small_sort(const lean::expr & type) {
+    return lean::is_sort(type) && (lean::is_zero(lean::sort_level(type)) || lean::sort_level(type) == lean::mk_level_one());
+}
+
+size_t TermGenerator::random(size_t bound) {
+    return bound == 0 ? 0 : std::uniform_int_distribution<size_t>(0, bound - 1)(rng);
+}
+
+bool TermGenerator::representable(const lean::name & n) const {
+    for (lean::name it = n; !it.is_anonymous(); it = it.get_prefix()) {
+        if (it.is_string()) {
+            if (table_set.count(it.get_string().to_std_string()) == 0) {
+                return false;
+            }
+        } else if (!it.get_numeral().is_small() || it.get_numeral().get_small_value() > 0xffff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+lean::name TermGenerator::fresh_name() {
+    while (true) {
+        lean::name n(binder_name, next_name++);
+        if (!env.find(n)) {
+            return n;
+        }
+    }
+}
+
+lean::expr TermGenerator::instantiate_head(const lean::constant_info & info) {
+    std::vector<lean::level> ls;
+    for (unsigned i = 0; i < info.get_num_lparams(); ++i) {
+        lean::level l = lean::mk_level_zero();
+        for (size_t k = random(3); k > 0; --k) {
+            l = lean::mk_succ(l);
+        }
+        ls.push_back(l);
+    }
+    return lean::mk_constant(info.get_name(), lean::levels(ls.begin(), ls.end()));
+}
+
+lean::optional<lean::constant_info> TermGenerator::random_head(const lean::expr * goal) {
+    // Constants whose conclusion has the same head as the goal first
+    lean::optional<lean::name> head = goal ? result_head(*goal) : lean::optional<lean::name>();
+    if (head && random(4) != 0) {
+        auto base = base_by_result.find(*head);
+        auto local = by_result.find(*head);
+        size_t num_base = base == base_by_result.end() ? 0 : base->second.size();
+        size_t num_local = local == by_result.end() ? 0 : local->second.size();
+        if (num_base + num_local > 0) {
+            size_t k = random(num_base + num_local);
+            return lean::optional<lean::constant_info>(k < num_base ? base->second[k] : local->second[k - num_base]);
+        }
+    }
+    if (random(3) == 0) {
+        size_t k = random(base_recursors.size() + recursors.size());
+        if (k < base_recursors.size()) {
+            return lean::optional<lean::constant_info>(base_recursors[k]);
+        } else if (k - base_recursors.size() < recursors.size()) {
+            return lean::optional<lean::constant_info>(recursors[k - base_recursors.size()]);
+        }
+    }
+    size_t k = random(base_heads.size() + heads.size());
+    if (k < base_heads.size()) {
+        return lean::optional<lean::constant_info>(base_heads[k]);
+    } else if (k - base_heads.size() < heads.size()) {
+        return lean::optional<lean::constant_info>(heads[k - base_heads.size()]);
+    }
+    return lean::optional<lean::constant_info>();
+}
+
+lean::optional<lean::expr> TermGenerator::term_of_type(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                                       const std::vector<typed_term> & locals, const lean::expr & type,
+                                                       unsigned depth) {
+    lean::expr goal = tc.whnf(type);
+    if (lean::is_pi(goal) && depth > 0 && random(4) != 0) {
+        return lambda_of_type(lctx, locals, goal, depth);
+    }
+    if (depth > 0 && !binder_name.is_anonymous() && random(8) == 0) {
+        if (lean::optional<lean::expr> e = let_of_type(tc, lctx, locals, goal, depth)) {
+            return e;
+        }
+    }
+
+    // Something at hand whose type matches
+    size_t num_candidates = locals.size() + values.size();
+    for (unsigned i = 0; i < max_candidates && num_candidates > 0; ++i) {
+        size_t k = random(num_candidates);
+        const typed_term & c = k < locals.size() ? locals[k] : values[k - locals.size()];
+        if (tc.is_def_eq(c.type, goal)) {
+            return lean::some_expr(c.value);
+        }
+    }
+    if (nat_type && tc.is_def_eq(goal, *nat_type)) {
+        return lean::some_expr(lean::mk_lit(lean::literal(static_cast<unsigned>(random(1 << (1 + random(16)))))));
+    }
+    if (string_type && tc.is_def_eq(goal, *string_type)) {
+        std::string s(random(4), 'a' + random(26));
+        return lean::some_expr(lean::mk_lit(lean::literal(s.c_str())));
+    }
+
+    if (depth > 0) {
+        for (unsigned i = 0; i < max_heads; ++i) {
+            lean::optional<lean::expr> f;
+            if (!locals.empty() && random(3) == 0) {
+                f = locals[random(locals.size())].value;
+            } else if (lean::optional<lean::constant_info> info = random_head(&goal)) {
+                f = instantiate_head(*info);
+            }
+            if (f) {
+                if (lean::optional<lean::expr> e = apply_towards(tc, lctx, locals, *f, &goal, depth - 1)) {
+                    return e;
+                }
+            }
+        }
+    }
+    if (lean::is_pi(goal) && depth > 0) {
+        return lambda_of_type(lctx, locals, goal, depth);
+    }
+    return lean::none_expr();
+}
+
+lean::optional<lean::expr> TermGenerator::lambda_of_type(const lean::local_ctx & lctx,
+                                                         const std::vector<typed_term> & locals,
+                                                         const lean::expr & pi, unsigned depth) {
+    lean::local_ctx inner = lctx;
+    lean::expr x = inner.mk_local_decl(ngen, binder_name, lean::binding_domain(pi), lean::binding_info(pi));
+    lean::type_checker inner_tc(env, inner);
+    std::vector<typed_term> inner_locals = locals;
+    inner_locals.push_back({ x, lean::binding_domain(pi) });
+    lean::optional<lean::expr> body = term_of_type(inner_tc, inner, inner_locals,
+                                                   lean::instantiate(lean::binding_body(pi), x), depth - 1);
+    if (!body) {
+        return lean::none_expr();
+    }
+    return lean::some_expr(inner.mk_lambda(x, *body));
+}
+
+lean::optional<lean::expr> TermGenerator::let_of_type(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                                      const std::vector<typed_term> & locals, const lean::expr & type,
+                                                      unsigned depth) {
+    lean::optional<typed_term> v = random_term(tc, depth - 1);
+    if (!v) {
+        return lean::none_expr();
+    }
+    lean::local_ctx inner = lctx;
+    lean::expr x = inner.mk_local_decl(ngen, binder_name, v->type, v->value);
+    lean::type_checker inner_tc(env, inner);
+    std::vector<typed_term> inner_locals = locals;
+    inner_locals.push_back({ x, v->type });
+    lean::optional<lean::expr> body = term_of_type(inner_tc, inner, inner_locals, type, depth - 1);
+    if (!body) {
+        return lean::none_expr();
+    }
+    // `x` has a value, so this is a `let`
+    return lean::some_expr(inner.mk_lambda(x, *body));
+}
+
+lean::optional<lean::expr> TermGenerator::apply_towards(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                                        const std::vector<typed_term> & locals, lean::expr f,
+                                                        const lean::expr * goal, unsigned depth) {
+    lean::expr f_type = tc.infer(f);
+    // Without a goal, stop after a random number of arguments
+    size_t num_args = goal ? max_args : random(6);
+    for (size_t i = 0; i <= max_args; ++i) {
+        if (goal ? tc.is_def_eq(f_type, *goal) : i == num_args) {
+            return lean::some_expr(f);
+        }
+        lean::expr pi = tc.whnf(f_type);
+        if (!lean::is_pi(pi)) {
+            return goal ? lean::none_expr() : lean::some_expr(f);
+        }
+        lean::optional<lean::expr> arg = term_of_type(tc, lctx, locals, lean::binding_domain(pi), depth);
+        if (!arg) {
+            return lean::none_expr();
+        }
+        f = lean::mk_app(f, *arg);
+        f_type = lean::instantiate(lean::binding_body(pi), *arg);
+    }
+    return lean::none_expr();
+}
+
+lean::optional<TermGenerator::typed_term> TermGenerator::random_term(lean::type_checker & tc, unsigned depth) {
+    lean::optional<lean::constant_info> info = random_head(nullptr);
+    if (!info) {
+        return lean::optional<typed_term>();
+    }
+    lean::optional<lean::expr> e = apply_towards(tc, lean::local_ctx(), {}, instantiate_head(*info), nullptr, depth);
+    if (!e) {
+        return lean::optional<typed_term>();
+    }
+    return lean::optional<typed_term>(typed_term{ *e, tc.infer(*e) });
+}
+
+lean::optional<lean::declaration> TermGenerator::generate_definition() {
+    lean::type_checker tc(env);
+    lean::optional<lean::expr> value;
+    lean::expr type;
+    if (!types.empty() && random(2) == 0) {
+        // For a given type, possibly a function type
+        type = types[random(types.size())];
+        if (random(2) == 0) {
+            type = lean::mk_pi(binder_name, types[random(types.size())], type);
+        }
+        value = term_of_type(tc, lean::local_ctx(), {}, type, options.max_depth);
+    } else {
+        if (lean::optional<typed_term> t = random_term(tc, options.max_depth)) {
+            value = t->value;
+            type = t->type;
+        }
+    }
+    if (!value) {
+        return lean::none_declaration();
+    }
+    lean::name n = fresh_name();
+    if (tc.is_prop(type)) {
+        return lean::some_declaration(lean::mk_theorem(n, lean::names(), type, *value));
+    }
+    return lean::some_declaration(lean::mk_definition(env, n, lean::names(), type, *value));
+}
+
+lean::optional<lean::declaration> TermGenerator::generate_inductive() {
+    if (types.empty()) {
+        return lean::none_declaration();
+    }
+    lean::name ind = fresh_name();
+    lean::expr self = lean::mk_constant(ind);
+    lean::expr sort = random(4) == 0 ? lean::mk_Prop() : lean::mk_Type();
+    std::vector<lean::constructor> ctors;
+    for (unsigned c = 0, num_ctors = 1 + random(3); c < num_ctors; ++c) {
+        // Fields are non-dependent, and recursive occurrences are direct, so the type is positive
+        lean::expr type = self;
+        for (size_t f = random(4); f > 0; --f) {
+            lean::expr field = random(3) == 0 ? self : types[random(types.size())];
+            type = lean::mk_pi(binder_name, field, type);
+        }
+        ctors.push_back(lean::constructor(lean::name(ind, c), type));
+    }
+    std::vector<lean::inductive_type> inds = {
+        lean::inductive_type(ind, sort, lean::constructors(ctors.begin(), ctors.end()))
+    };
+    return lean::some_declaration(lean::mk_inductive_decl(lean::names(), lean::nat(0),
+                                                          lean::inductive_types(inds.begin(), inds.end()), false));
+}
+
+void TermGenerator::add_head(const lean::constant_info & info) {
+    if (info.is_recursor()) {
+        recursors.push_back(info);
+        return;
+    }
+    heads.push_back(info);
+    if (lean::optional<lean::name> head = result_head(info.get_type())) {
+        by_result[*head].push_back(info);
+    }
+}
+
+bool TermGenerator::try_add(const lean::declaration & d) {
+    try {
+        env = env.add(d);
+    } catch (const std::exception &) {
+        return false;
+    }
+    decls.push_back(d);
+
+    if (d.is_inductive()) {
+        for (const lean::inductive_type & ind : lean::inductive_decl(d).get_types()) {
+            add_head(env.get(ind.get_name()));
+            for (const lean::constructor & c : ind.get_cnstrs()) {
+                add_head(env.get(lean::constructor_name(c)));
+            }
+            add_head(env.get(lean::name(ind.get_name(), "rec")));
+            types.push_back(lean::mk_constant(ind.get_name()));
+        }
+    } else {
+        lean::constant_info info = env.get(d.is_theorem() ? d.to_theorem_val().get_name()
+                                                          : d.to_definition_val().get_name());
+        add_head(info);
+        values.push_back({ lean::mk_constant(info.get_name()), info.get_type() });
+        if (is_small_sort(info.get_type())) {
+            types.push_back(lean::mk_constant(info.get_name()));
+        }
+    }
+    return true;
+}
+
+std::vector<std::uint8_t> TermGenerator::generate_testcase(const check_budget & budget) {
+    env = prelude_env;
+    heads.clear();
+    recursors.clear();
+    by_result.clear();
+    values = base_values;
+    types = base_types;
+    decls.clear();
+    next_name = 0;
+
+    for (size_t i = 0, num_decls = 1 + random(options.max_decls); i < num_decls; ++i) {
+        // Same limits as `check_testcase`, for generating and adding the declaration
+        lean::scope_max_heartbeat max_heartbeat(budget.max_heartbeat);
+        lean::scope_heartbeat heartbeat(0);
+        lean::scope_max_stack max_stack(budget.max_stack);
+        try {
+            lean::optional<lean::declaration> d = random(3) == 0 ? generate_inductive() : generate_definition();
+            if (d) {
+                try_add(*d);
+            }
+        } catch (const std::exception &) {
+            // Dropped, like a declaration the kernel rejects
+        }
+    }
+    if (decls.empty()) {
+        return {};
+    }
+
+    std::vector<std::string> new_table = table;
+    BinWriter w(new_table);
+    try {
+        for (const lean::declaration & d : decls) {
+            w.add_declaration(d);
+        }
+    } catch (const lean::exception &) {
+        return {};
+    }
+    if (w.get_new_strings() > 0) {
+        return {};
+    }
+    return w.get_data();
+}
+
+TermGenerator::TermGenerator(const lean::environment & _prelude_env, const StringPool & strings, std::uint64_t seed,
+                             const generator_options & _options) :
+        rng(seed),
+        prelude_env(_prelude_env),
+        options(_options),
+        table(),
+        table_set(),
+        ngen(),
+        binder_name(),
+        env(_prelude_env),
+        next_name(0) {
+    for (size_t i = 0; i < strings.size(); ++i) {
+        table.push_back(strings.get_string(i));
+    }
+    table_set.insert(table.begin(), table.end());
+    for (char const * candidate : { "x", "a", "n" }) {
+        if (table_set.count(candidate)) {
+            binder_name = lean::name(candidate);
+            break;
+        }
+    }
+    for (char const * n : { "Nat", "String" }) {
+        if (lean::optional<lean::constant_info> info = prelude_env.find(lean::name(n))) {
+            (std::string(n) == "Nat" ? nat_type : string_type) = lean::mk_constant(info->get_name());
+        }
+    }
+
+    prelude_env.for_each_constant([&](const lean::constant_info & info) {
+        if (info.is_unsafe() || !representable(info.get_name())) {
+            return;
+        }
+        if (info.is_recursor()) {
+            base_recursors.push_back(info);
+            return;
+        }
+        base_heads.push_back(info);
+        if (lean::optional<lean::name> head = result_head(info.get_type())) {
+            base_by_result[*head].push_back(info);
+        }
+        if (info.get_num_lparams() == 0) {
+            if (is_small_sort(info.get_type())) {
+                base_types.push_back(lean::mk_constant(info.get_name()));
+            }
+            if (!lean::is_pi(info.get_type())) {
+                base_values.push_back({ lean::mk_constant(info.get_name()), info.get_type() });
+            }
+        }
+    });
+    base_values.push_back({ lean::mk_Prop(), lean::mk_Type() });
+}
+
+static void write_testcase(const std::filesystem::path & fname, const std::vector<std::uint8_t> & data) {
+    std::ofstream out(fname, std::ios_base::binary);
+    out.write(reinterpret_cast<char const *>(data.data()), data.size());
+}
+
+int run_generate(const StringPool & strings, const lean::environment & prelude_env, const check_budget & budget,
+                 const generator_options & options) {
+    if (!options.output_dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(options.output_dir, ec);
+        if (ec) {
+            std::cout << "Cannot create " << options.output_dir << ": " << ec.message() << std::endl;
+            return setup_error_exit_code;
+        }
+    }
+    unsigned jobs = std::max(1u, std::min<unsigned>(options.jobs, options.count));
+    check_budget worker_budget = budget;
+    if (jobs > 1) {
+        // See `run_batch`
+        worker_budget.max_memory = 0;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> empty(0);
+    std::atomic<size_t> outcome_counts[num_check_outcomes] = {};
+    auto worker = [&](unsigned w) {
+        TermGenerator gen(prelude_env, strings, options.seed * jobs + w, options);
+        for (size_t i = next++; i < options.count; i = next++) {
+            std::vector<std::uint8_t> data = gen.generate_testcase(worker_budget);
+            if (data.empty()) {
+                ++empty;
+                continue;
+            }
+            char fname[32];
+            snprintf(fname, sizeof(fname), "gen-%06zu.belean", i);
+            if (!options.output_dir.empty()) {
+                write_testcase(std::filesystem::path(options.output_dir) / fname, data);
+                continue;
+            }
+
+            check_outcome outcome = check_in_iteration_heap(data.data(), data.size(), strings, prelude_env,
+                                                            worker_budget);
+            outcome_counts[static_cast<size_t>(outcome)]++;
+            if (outcome == check_outcome::proof_of_false) {
+                write_testcase(fname, data);
+                std::cout << "Have a proof of false?! Written to " << fname << std::endl;
+                abort();
+            } else if (outcome != check_outcome::accepted) {
+                // Every declaration was accepted before it was written, so this is a difference
+                // between the declarations and what `BinParser` reads back
+                write_testcase(fname, data);
+            }
+        }
+    };
+
+    if (jobs == 1) {
+        worker(0);
+    } else {
+        std::vector<std::unique_ptr<lean::lthread>> threads;
+        for (unsigned w = 0; w < jobs; ++w) {
+            threads.emplace_back(new lean::lthread([&worker, w]() { worker(w); }));
+        }
+        for (auto & t : threads) {
+            t->join();
+        }
+    }
+
+    std::cout << options.count - empty << " testcases generated, " << empty << " without accepted declarations" << std::endl;
+    if (options.output_dir.empty()) {
+        for (size_t i = 0; i < num_check_outcomes; ++i) {
+            std::cout << outcome_name(static_cast<check_outcome>(i)) << ": " << outcome_counts[i] << std::endl;
+        }
+    }
+    return 0;
+}
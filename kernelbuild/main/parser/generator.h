@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "harness.h"
+#include "kernel/environment.h"
+#include "kernel/type_checker.h"
+#include "util/name_hash_map.h"
+
+/* Type-directed generation of well-typed testcases.
+
+   Random bytes rarely get past `infer_app`, so the deeper parts of `is_def_eq_core` are reached
+   mostly by the corpus. The generator builds declarations that type check instead, using the
+   kernel itself: terms are built for a goal type by `whnf`-ing the goal, introducing a lambda
+   for a Pi, and otherwise applying constants of the prelude (recursors in particular) and
+   earlier declarations to arguments built for the domains `whnf` exposes, accepting a candidate
+   when `is_def_eq` says its type matches the goal. Inductive types with random constructors are
+   generated too, and their recursors become heads for later terms.
+
+   Every declaration is added to a copy of the prelude environment and dropped if the kernel
+   rejects it, so a testcase is a sequence of accepted definitions, theorems and inductives,
+   written with `BinWriter`. All names are built from entries of the `strings` table. */
+
+struct generator_options {
+    unsigned jobs = 1;
+    // Number of testcases
+    size_t count = 1000;
+    // Declarations attempted per testcase
+    unsigned max_decls = 4;
+    // Nesting depth of lambdas and applications
+    unsigned max_depth = 3;
+    std::uint64_t seed = 0;
+    // Where testcases are written. If empty, they are checked in-process instead, see `run_generate`.
+    std::string output_dir;
+};
+
+class TermGenerator {
+public:
+    // `prelude_env` and `strings` are borrowed and must outlive the generator. The generator keeps
+    // Lean objects that are not thread safe, so every thread needs its own.
+    TermGenerator(const lean::environment & prelude_env, const StringPool & strings, std::uint64_t seed,
+                  const generator_options & options);
+
+    // Returns a testcase in the binary format, or nothing if no declaration was accepted.
+    std::vector<std::uint8_t> generate_testcase(const check_budget & budget);
+
+private:
+    struct typed_term {
+        lean::expr value;
+        lean::expr type;
+    };
+
+    size_t random(size_t bound);
+    bool representable(const lean::name & n) const;
+    lean::name fresh_name();
+    lean::expr instantiate_head(const lean::constant_info & info);
+    // A constant to apply, preferably one whose conclusion has the same head as `goal`
+    lean::optional<lean::constant_info> random_head(const lean::expr * goal);
+
+    /* Terms */
+    lean::optional<lean::expr> term_of_type(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                            const std::vector<typed_term> & locals, const lean::expr & type,
+                                            unsigned depth);
+    lean::optional<lean::expr> lambda_of_type(const lean::local_ctx & lctx, const std::vector<typed_term> & locals,
+                                              const lean::expr & pi, unsigned depth);
+    lean::optional<lean::expr> let_of_type(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                           const std::vector<typed_term> & locals, const lean::expr & type,
+                                           unsigned depth);
+    lean::optional<lean::expr> apply_towards(lean::type_checker & tc, const lean::local_ctx & lctx,
+                                             const std::vector<typed_term> & locals, lean::expr f,
+                                             const lean::expr * goal, unsigned depth);
+    lean::optional<typed_term> random_term(lean::type_checker & tc, unsigned depth);
+
+    /* Declarations */
+    lean::optional<lean::declaration> generate_definition();
+    lean::optional<lean::declaration> generate_inductive();
+    void add_head(const lean::constant_info & info);
+    bool try_add(const lean::declaration & d);
+
+    /* Data members */
+
+    std::mt19937_64 rng;
+    const lean::environment & prelude_env;
+    const generator_options & options;
+    std::vector<std::string> table;
+    std::unordered_set<std::string> table_set;
+    lean::name_generator ngen;
+    // A name from the table, used for binders and as the prefix of new declarations
+    lean::name binder_name;
+    lean::optional<lean::expr> nat_type;
+    lean::optional<lean::expr> string_type;
+
+    // Computed once from the prelude
+    std::vector<lean::constant_info> base_heads;
+    std::vector<lean::constant_info> base_recursors;
+    std::vector<typed_term> base_values;
+    std::vector<lean::expr> base_types;
+    // Heads by the head constant of their conclusion
+    lean::name_hash_map<std::vector<lean::constant_info>> base_by_result;
+
+    // The testcase being generated
+    lean::environment env;
+    std::vector<lean::constant_info> heads;
+    std::vector<lean::constant_info> recursors;
+    lean::name_hash_map<std::vector<lean::constant_info>> by_result;
+    std::vector<typed_term> values;
+    std::vector<lean::expr> types;
+    std::vector<lean::declaration> decls;
+    unsigned next_name;
+};
+
+// Generates `options.count` testcases on `options.jobs` threads. With an `output_dir`, they are
+// written there as seeds. Otherwise every testcase goes through `BinParser` and `check_testcase`
+// like an AFL input: testcases the kernel rejects after the round trip are written to the working
+// directory, and a proof of `False` aborts. Returns 0, or `setup_error_exit_code`.
+int run_generate(const StringPool & strings, const lean::environment & prelude_env, const check_budget & budget,
+                 const generator_options & options);
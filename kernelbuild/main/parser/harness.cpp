@@ -0,0 +1,368 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "harness.h"
+#include "parser.h"
+#include "iteration_heap.h"
+#include "snapshot.h"
+#include "startup_profile.h"
+#include "kernel/kernel_exception.h"
+#include "runtime/interrupt.h"
+#include "runtime/memory.h"
+#include "runtime/stackinfo.h"
+#include "runtime/exception.h"
+#include "runtime/object.h"
+#include "runtime/thread.h"
+
+#include <exception>
+#include <new>
+#include <typeinfo>
+#include <cxxabi.h>
+#include <optional>
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+extern "C" void lean_initialize_runtime_module();
+extern "C" void lean_initialize();
+extern "C" void lean_io_mark_end_initialization();
+// extern "C" lean_object * initialize_Lean_Environment(uint8_t builtin, lean_object *);
+
+extern "C" lean_object* lean_mk_empty_environment(uint32_t trust_level, lean_object* /* world */);
+
+void initialize_runtime() {
+    {
+        StartupPhase phase("lean_initialize_runtime");
+        lean_initialize_runtime_module();
+    }
+    {
+        // Runs the initializers of all compiled Lean modules in `lean_export/`
+        StartupPhase phase("lean_initialize");
+        lean_initialize();
+    }
+    lean_io_mark_end_initialization();
+}
+
+std::vector<std::string> read_strings() {
+    StartupPhase phase("read_strings");
+    std::ifstream stream("strings");
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    std::vector<std::string> result;
+    std::string s;
+    while (std::getline(buffer, s, '\n')) {
+        result.push_back(s);
+    }
+    return result;
+}
+
+MappedFile read_prelude() {
+    StartupPhase phase("read_prelude");
+    try {
+        return MappedFile("prelude.elean");
+    } catch (const std::filesystem::filesystem_error &) {
+        // Reported as a version mismatch by the parser
+        return MappedFile();
+    }
+}
+
+lean::elab_environment mk_empty_environment() {
+    lean_object *io_ress = lean_mk_empty_environment(0, lean_io_mk_world());
+    lean_inc(io_ress);
+    lean_object *eenv = lean_io_result_get_value(io_ress);
+
+    return lean::elab_environment(eenv, true);
+}
+
+char const * declaration_kind_name(lean::declaration_kind kind) {
+    switch (kind) {
+    case lean::declaration_kind::Axiom:            return "axiom";
+    case lean::declaration_kind::Definition:       return "definition";
+    case lean::declaration_kind::Theorem:          return "theorem";
+    case lean::declaration_kind::Opaque:           return "opaque";
+    case lean::declaration_kind::Quot:             return "quot";
+    case lean::declaration_kind::MutualDefinition: return "mutual";
+    case lean::declaration_kind::Inductive:        return "inductive";
+    }
+    return "unknown";
+}
+
+lean::optional<lean::elab_environment> check_prelude(std::string_view prelude) {
+    Parser p(true, 0, term_sharing_enabled());
+    {
+        StartupPhase phase("prelude.parse");
+        p.handle_file(sz::string_view(prelude.data(), prelude.size()));
+    }
+    if (term_sharing_enabled()) {
+        print_sharing_stats("Prelude sharing", p.get_sharing_stats());
+    }
+
+    if (p.is_error()) {
+        return lean::optional<lean::elab_environment>();
+    }
+    
+    lean::elab_environment elab_env = mk_empty_environment();
+    
+    bool profile = startup_profile_enabled();
+    try {
+        StartupPhase phase("prelude.add");
+        for (const lean::declaration & d : p.get_decls()) {
+          auto start = std::chrono::steady_clock::now();
+          elab_env = elab_env.add(d);
+          if (profile) {
+              record_prelude_decl(d, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+          }
+        }
+    } catch (const lean::unknown_constant_exception &ex) {
+        std::cout << "Unkown constant: " << ex.get_name() << std::endl;
+    }
+
+    // The prelude environment lives until the process exits. Marking its object graph persistent
+    // turns every `lean_inc`/`lean_dec` on it (for example in `environment::get` and whenever a
+    // prelude `expr` is copied) into a no-op, which saves an atomic operation per access inside the
+    // fuzzing loop. Environments loaded from a snapshot are persistent already, since compacted
+    // objects have no reference count.
+    //
+    // Thunks are forced first. A thunk forced in the fuzzing loop would store a value from the
+    // `IterationHeap` in the persistent graph, which is a use after free once the heap is gone.
+    {
+        StartupPhase phase("prelude.mark_persistent");
+        force_thunks(elab_env.raw());
+        lean::mark_persistent(elab_env.raw());
+    }
+
+    return lean::optional<lean::elab_environment>(elab_env);
+}
+
+lean::optional<lean::elab_environment> load_prelude(std::string_view prelude, std::string const & snapshot_fname) {
+    if (!snapshot_fname.empty()) {
+        lean::optional<lean::elab_environment> env;
+        {
+            StartupPhase phase("prelude.load_snapshot");
+            env = load_snapshot(snapshot_fname, prelude_hash(prelude));
+        }
+        if (env) {
+            return env;
+        }
+    }
+    return check_prelude(prelude);
+}
+
+int check_budget::parse_arg(int argc, char * argv[], int i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+        return 0;
+    }
+    if (arg == "--max-heartbeats") {
+        max_heartbeat = std::stoull(argv[i + 1]);
+    } else if (arg == "--max-memory") {
+        max_memory = std::stoull(argv[i + 1]) * 1024 * 1024;
+    } else if (arg == "--max-stack") {
+        max_stack = std::stoull(argv[i + 1]) * 1024;
+    } else {
+        return 0;
+    }
+    return 2;
+}
+
+scope_check_budget::scope_check_budget(check_budget const & budget) :
+        max_heartbeat(budget.max_heartbeat),
+        heartbeat(0),
+        max_stack(budget.max_stack) {
+    if (budget.max_memory > 0) {
+        // The ceiling is relative to the memory in use now, which includes the prelude
+        max_memory.emplace(lean::get_allocated_memory() + budget.max_memory);
+    }
+}
+
+static std::string exception_name(std::exception const & ex) {
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(typeid(ex).name(), nullptr, nullptr, &status);
+    std::string result = status == 0 ? demangled : typeid(ex).name();
+    free(demangled);
+    return result;
+}
+
+// Adds the declarations `next` returns until it returns none, then the proof of `False`
+static check_outcome add_decls(lean::environment & env, BinParser & p,
+                               std::function<lean::optional<lean::declaration>()> const & next, std::string & error) {
+    try {
+        while (lean::optional<lean::declaration> d = next()) {
+            env = env.add(*d);
+        }
+        // Known only now that the input is parsed to the end
+        if (lean::optional<lean::declaration> d = p.false_declaration()) {
+            env = env.add(*d);
+            return check_outcome::proof_of_false;
+        }
+    } catch (const lean::heartbeat_exception &) {
+        return check_outcome::budget_exceeded;
+    } catch (const lean::memory_exception &) {
+        return check_outcome::budget_exceeded;
+    } catch (const lean::stack_space_exception &) {
+        return check_outcome::budget_exceeded;
+    } catch (const std::bad_alloc &) {
+        return check_outcome::budget_exceeded;
+    } catch (const std::exception & ex) {
+        error = exception_name(ex);
+        return check_outcome::kernel_error;
+    } catch (...) {
+        error = "unknown exception";
+        return check_outcome::kernel_error;
+    }
+    return check_outcome::accepted;
+}
+
+static check_outcome check_decls(lean::environment & env, BinParser & p,
+                                 std::function<lean::optional<lean::declaration>()> const & next,
+                                 check_budget const & budget, check_stats * stats) {
+    scope_check_budget scope(budget);
+
+    std::string error;
+    check_outcome outcome = add_decls(env, p, next, error);
+    if (stats) {
+        stats->heartbeats = lean::get_heartbeat();
+        stats->error = error;
+    }
+    return outcome;
+}
+
+check_outcome check_testcase(lean::environment & env, BinParser & p, check_budget const & budget,
+                             check_stats * stats) {
+    // What `handle_data` parsed already, then the rest of the input
+    size_t i = 0;
+    auto next = [&]() {
+        if (i < p.get_decls().size()) {
+            return lean::some_declaration(p.get_decls()[i++]);
+        }
+        return p.next_declaration();
+    };
+    return check_decls(env, p, next, budget, stats);
+}
+
+// Declarations the parser thread may be ahead of the kernel
+static constexpr size_t pipeline_depth = 64;
+
+check_outcome check_testcase_pipelined(lean::environment & env, BinParser & p, check_budget const & budget,
+                                       check_stats * stats) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<lean::declaration> queue;
+    bool done = false;
+    bool stop = false;
+    // Thrown by the parser, rethrown on the kernel thread after the declarations before it
+    std::exception_ptr parse_error;
+
+    lean::lthread parser([&]() {
+        while (true) {
+            lean::optional<lean::declaration> d;
+            std::exception_ptr error;
+            try {
+                d = p.next_declaration();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            if (d) {
+                // The kernel thread takes references to it, and to the tables of the parser
+                lean::mark_mt(d->raw());
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return stop || queue.size() < pipeline_depth; });
+            if (stop) {
+                return;
+            }
+            if (!d) {
+                parse_error = error;
+                done = true;
+                cv.notify_all();
+                return;
+            }
+            queue.push_back(*d);
+            cv.notify_all();
+        }
+    });
+
+    auto next = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return done || !queue.empty(); });
+        if (queue.empty()) {
+            if (parse_error) {
+                // Classified by `add_decls` like in `check_testcase`, so `std::bad_alloc` is over
+                // budget rather than the end of a truncated input
+                std::rethrow_exception(parse_error);
+            }
+            return lean::none_declaration();
+        }
+        lean::declaration d = queue.front();
+        queue.pop_front();
+        cv.notify_all();
+        return lean::some_declaration(d);
+    };
+    check_outcome outcome = check_decls(env, p, next, budget, stats);
+
+    // After a rejected declaration, the parser is still running
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+        queue.clear();
+        cv.notify_all();
+    }
+    parser.join();
+    return outcome;
+}
+
+check_outcome check_in_iteration_heap(const std::uint8_t * data, size_t len, StringPool const & strings,
+                                      lean::environment const & prelude_env, check_budget const & budget,
+                                      bool share_terms, iteration_stats * stats, bool parse_first) {
+    // Released in one go at the end, instead of one `lean_dec_ref` at a time
+    IterationHeap heap;
+
+    BinParser & p = *heap.make<BinParser>(strings, share_terms);
+    if (parse_first) {
+        auto start = std::chrono::steady_clock::now();
+        p.handle_data(data, len);
+        if (stats) {
+            stats->parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    } else {
+        p.start(data, len);
+    }
+
+    lean::environment & env = *heap.make<lean::environment>(prelude_env);
+    check_outcome outcome = check_testcase(env, p, budget, stats);
+    if (stats) {
+        stats->heap_committed = heap.committed();
+        stats->sharing = p.get_sharing_stats();
+    }
+    return outcome;
+}
+
+char const * outcome_name(check_outcome outcome) {
+    switch (outcome) {
+    case check_outcome::accepted:        return "accepted";
+    case check_outcome::kernel_error:    return "kernel error";
+    case check_outcome::budget_exceeded: return "budget exceeded";
+    case check_outcome::proof_of_false:  return "proof of False";
+    }
+    return "unknown";
+}
+
+std::string outcome_signature(check_outcome outcome, check_stats const & stats) {
+    if (outcome == check_outcome::kernel_error) {
+        return std::string(outcome_name(outcome)) + ": " + stats.error;
+    }
+    return outcome_name(outcome);
+}
+
+int outcome_exit_code(check_outcome outcome) {
+    return static_cast<int>(outcome);
+}
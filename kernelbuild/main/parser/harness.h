@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <optional>
+#include "binparser.h"
+#include "mapped_file.h"
+#include "runtime/optional.h"
+#include "runtime/interrupt.h"
+#include "runtime/memory.h"
+#include "runtime/stackinfo.h"
+#include "library/elab_environment.h"
+
+/* Setup shared by all fuzzing entry points (the AFL driver and the libFuzzer target). All files
+   are read from the working directory. */
+
+void initialize_runtime();
+
+// Reads the string table `strings` that testcases refer to by index
+std::vector<std::string> read_strings();
+
+// Maps `prelude.elean`, empty if it cannot be read
+MappedFile read_prelude();
+
+lean::elab_environment mk_empty_environment();
+
+// Short lowercase name of `kind`, like `definition` or `mutual`
+char const * declaration_kind_name(lean::declaration_kind kind);
+
+// Checks the prelude from scratch and marks the resulting environment persistent.
+// Returns `none` if the prelude cannot be parsed.
+lean::optional<lean::elab_environment> check_prelude(std::string_view prelude);
+
+// Loads the prelude environment from the snapshot `snapshot_fname` if it is nonempty and
+// up to date, and checks it from scratch otherwise.
+lean::optional<lean::elab_environment> load_prelude(std::string_view prelude, std::string const & snapshot_fname);
+
+/* Checking a single testcase against the prelude environment.
+
+   Every testcase is checked under a resource budget, so that pathological inputs (deep
+   `Nat.pow`, runaway delta unfolding, ...) are cut off deterministically after a few
+   milliseconds instead of running into AFL's timeout. */
+
+enum class check_outcome {
+    accepted = 0,
+    kernel_error = 1,
+    budget_exceeded = 2,
+    proof_of_false = 3,
+};
+
+constexpr size_t num_check_outcomes = 4;
+
+struct check_budget {
+    // Maximum number of heartbeats (see `check_heartbeat`), 0 for no limit
+    size_t max_heartbeat = 200000;
+    // Maximum growth of the resident set in bytes while checking, 0 for no limit. The resident set
+    // is shared by all threads, so this must be 0 when checking on several threads at once.
+    size_t max_memory = static_cast<size_t>(512) * 1024 * 1024;
+    // Maximum stack space in bytes used while checking, 0 for no limit. This is what bounds the
+    // recursion depth of the kernel, since every recursive step goes through `check_system`.
+    size_t max_stack = static_cast<size_t>(1024) * 1024;
+
+    // Handles `--max-heartbeats N`, `--max-memory MB` and `--max-stack KB`. Returns the number of
+    // arguments consumed, which is 0 if `argv[i]` is not a budget option.
+    int parse_arg(int argc, char * argv[], int i);
+};
+
+// Applies the limits of `budget` to the kernel on the current thread while it is alive, with the
+// heartbeat count starting from 0. `check_testcase` checks under one of these.
+class scope_check_budget {
+    lean::scope_max_heartbeat max_heartbeat;
+    lean::scope_heartbeat heartbeat;
+    lean::scope_max_stack max_stack;
+    // The ceiling is process wide, so it is left alone if there is none
+    std::optional<lean::scope_max_memory> max_memory;
+public:
+    explicit scope_check_budget(check_budget const & budget);
+};
+
+struct check_stats {
+    size_t heartbeats = 0;
+    // For `check_outcome::kernel_error`, the type of the exception the kernel threw
+    std::string error;
+};
+
+// Adds the declarations of `p`, followed by a proof of `False` if it can be stated, to `env`.
+// Stops at the first declaration the kernel rejects.
+//
+// `p` is either parsed with `handle_data` already, or `start`ed, in which case declarations are
+// parsed as they are added and the rest of the input is never parsed if one is rejected.
+//
+// This works on the kernel environment (`elab_environment::to_kernel_env` of the prelude):
+// `elab_environment::add` calls back into compiled Lean after every declaration to update
+// elaborator state that nothing here reads.
+check_outcome check_testcase(lean::environment & env, BinParser & p, check_budget const & budget,
+                             check_stats * stats = nullptr);
+
+// Like `check_testcase` for a `start`ed parser, but the parser runs on a thread of its own, ahead
+// of the kernel by a bounded number of declarations, so that parsing a large input overlaps with
+// checking it. Declarations cross threads, so this cannot be used in an `IterationHeap`.
+check_outcome check_testcase_pipelined(lean::environment & env, BinParser & p, check_budget const & budget,
+                                       check_stats * stats = nullptr);
+
+// What `check_in_iteration_heap` reports on top of `check_stats`
+struct iteration_stats : check_stats {
+    // Milliseconds `handle_data` took, if the input was parsed before checking
+    double parse_ms = 0;
+    // Bytes the `IterationHeap` had committed when checking finished, see `IterationHeap::committed`
+    size_t heap_committed = 0;
+    sharing_stats sharing;
+};
+
+// One iteration of the fuzzing loop: checks the binary testcase `data` like `check_testcase`,
+// against a copy of `prelude_env`, with the parser, the environment and everything the kernel
+// allocates in an `IterationHeap` that is released before this returns. `prelude_env` must be
+// persistent (see `check_prelude`).
+//
+// The input is parsed while it is checked, so the rest of it is skipped after a rejected
+// declaration. With `parse_first`, `handle_data` parses all of it first instead, for tools that
+// report the time parsing takes.
+check_outcome check_in_iteration_heap(const std::uint8_t * data, size_t len, StringPool const & strings,
+                                      lean::environment const & prelude_env, check_budget const & budget,
+                                      bool share_terms = false, iteration_stats * stats = nullptr,
+                                      bool parse_first = false);
+
+char const * outcome_name(check_outcome outcome);
+
+// `outcome_name`, followed by the type of the exception for `check_outcome::kernel_error`. This is
+// what the minimizer preserves and what triage groups by.
+std::string outcome_signature(check_outcome outcome, check_stats const & stats);
+
+// Exit code of the driver in file mode. The driver aborts on a proof of `False` instead, so that
+// it shows up as a crash.
+int outcome_exit_code(check_outcome outcome);
+
+// Exit code of the driver if it fails before checking the testcase, e.g. if the prelude is broken
+constexpr int setup_error_exit_code = 4;
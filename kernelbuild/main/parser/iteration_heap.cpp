@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "iteration_heap.h"
+
+#include <iostream>
+#include <unordered_set>
+#include <vector>
+
+IterationHeap::IterationHeap() :
+        heap(mi_heap_new()),
+        prev(nullptr) {
+    if (heap == nullptr) {
+        throw std::bad_alloc();
+    }
+    prev = mi_heap_set_default(heap);
+}
+
+IterationHeap::~IterationHeap() {
+    mi_heap_set_default(prev);
+    mi_heap_destroy(heap);
+}
+
+static bool add_committed(const mi_heap_t *, const mi_heap_area_t * area, void *, size_t, void * arg) {
+    *static_cast<size_t *>(arg) += area->committed;
+    return true;
+}
+
+size_t IterationHeap::committed() const {
+    size_t result = 0;
+    // Without `visit_blocks`, the visitor is called once per area
+    mi_heap_visit_blocks(heap, false, add_committed, &result);
+    return result;
+}
+
+// Same traversal as `lean_mark_persistent` in `runtime/object.cpp`
+void force_thunks(lean_object * root) {
+    std::unordered_set<lean_object *> visited;
+    std::vector<lean_object *> todo;
+    todo.push_back(root);
+    while (!todo.empty()) {
+        lean_object * o = todo.back();
+        todo.pop_back();
+        if (lean_is_scalar(o) || !visited.insert(o).second) {
+            continue;
+        }
+        std::uint8_t tag = lean_ptr_tag(o);
+        if (tag <= LeanMaxCtorTag) {
+            lean_object ** it  = lean_ctor_obj_cptr(o);
+            lean_object ** end = it + lean_ctor_num_objs(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            continue;
+        }
+        switch (tag) {
+        case LeanClosure: {
+            lean_object ** it  = lean_closure_arg_cptr(o);
+            lean_object ** end = it + lean_closure_num_fixed(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            break;
+        }
+        case LeanArray: {
+            lean_object ** it  = lean_array_cptr(o);
+            lean_object ** end = it + lean_array_size(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            break;
+        }
+        case LeanThunk:
+            // Stores the value and drops the closure
+            todo.push_back(lean_thunk_get(o));
+            break;
+        case LeanTask:
+            todo.push_back(lean_task_get(o));
+            break;
+        case LeanRef:
+            if (lean_object * v = lean_to_ref(o)->m_value) todo.push_back(v);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Same traversal as `lean_mark_persistent` in `runtime/object.cpp`
+void check_escapes(lean_object * root) {
+    std::unordered_set<lean_object *> visited;
+    std::vector<lean_object *> todo;
+    todo.push_back(root);
+    while (!todo.empty()) {
+        lean_object * o = todo.back();
+        todo.pop_back();
+        if (lean_is_scalar(o) || !visited.insert(o).second) {
+            continue;
+        }
+        if (!lean_is_persistent(o)) {
+            std::cout << "Object " << o << " with tag " << static_cast<unsigned>(lean_ptr_tag(o))
+                      << " escaped into the persistent environment" << std::endl;
+            abort();
+        }
+        std::uint8_t tag = lean_ptr_tag(o);
+        if (tag <= LeanMaxCtorTag) {
+            lean_object ** it  = lean_ctor_obj_cptr(o);
+            lean_object ** end = it + lean_ctor_num_objs(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            continue;
+        }
+        switch (tag) {
+        case LeanClosure: {
+            lean_object ** it  = lean_closure_arg_cptr(o);
+            lean_object ** end = it + lean_closure_num_fixed(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            break;
+        }
+        case LeanArray: {
+            lean_object ** it  = lean_array_cptr(o);
+            lean_object ** end = it + lean_array_size(o);
+            for (; it != end; ++it) todo.push_back(*it);
+            break;
+        }
+        case LeanThunk:
+            if (lean_object * c = lean_to_thunk(o)->m_closure) todo.push_back(c);
+            if (lean_object * v = lean_to_thunk(o)->m_value) todo.push_back(v);
+            break;
+        case LeanTask:
+            if (lean_object * v = lean_to_task(o)->m_value) todo.push_back(v);
+            break;
+        case LeanRef:
+            if (lean_object * v = lean_to_ref(o)->m_value) todo.push_back(v);
+            break;
+        default:
+            // Strings, scalar arrays, bignums and external objects have no Lean children
+            break;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <new>
+#include <utility>
+#include <mimalloc.h>
+#include <lean/lean.h>
+
+/* An allocation region for everything created while checking one testcase.
+
+   While an `IterationHeap` is alive it is the default mimalloc heap of the calling thread, so
+   every Lean object (`lean_alloc_small_object` uses `mi_malloc_small`), every `mpz` and every
+   container using `lean::allocator` is allocated from it. The destructor releases all of it at
+   once with `mi_heap_destroy`, without running destructors or `lean_dec_ref`.
+
+   This is only sound if nothing allocated in the heap is reachable once it is destroyed:
+   * Objects created with `make` are never destroyed, so they must only own memory from the heap
+     (in particular, no containers using `std::allocator`).
+   * Everything the iteration starts from must be persistent. Persistent objects are never updated
+     in place, so they cannot come to point into the heap. The one exception are thunks, which
+     store their value when forced, so `force_thunks` must run before the graph is marked
+     persistent (compacted snapshots store thunks forced already). `check_escapes` verifies this.
+   Locals with ordinary destructors are fine as long as they are declared after the heap. */
+class IterationHeap {
+public:
+    IterationHeap();
+    ~IterationHeap();
+
+    IterationHeap(const IterationHeap &) = delete;
+    IterationHeap & operator=(const IterationHeap &) = delete;
+
+    // Constructs a `T` in the heap. Its destructor is never run.
+    template<typename T, typename... Args> T * make(Args &&... args) {
+        void * mem = mi_heap_malloc_aligned(heap, sizeof(T), alignof(T));
+        if (mem == nullptr) {
+            throw std::bad_alloc();
+        }
+        return new (mem) T(std::forward<Args>(args)...);
+    }
+
+    // Bytes of memory currently committed by the heap. Pages that became empty may have been
+    // released already, so this can be less than the peak.
+    size_t committed() const;
+
+private:
+    mi_heap_t * heap;
+    mi_heap_t * prev;
+};
+
+// Forces every thunk reachable from `root`, including thunks inside their values. Call this
+// before `lean::mark_persistent(root)`, outside of any `IterationHeap`.
+void force_thunks(lean_object * root);
+
+// Aborts if an object reachable from the persistent `root` is not persistent itself, which means
+// that it was created after `root` was frozen and may live in an `IterationHeap`.
+// This walks the whole object graph, so it is meant for debugging only.
+void check_escapes(lean_object * root);
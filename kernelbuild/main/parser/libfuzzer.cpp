@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "binparser.h"
+#include "harness.h"
+#include "startup_profile.h"
+#include "kernel/rule_coverage.h"
+#include "library/elab_environment.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+
+/* libFuzzer entry points, so the same harness can be run under libFuzzer (and with it, under
+   honggfuzz, centipede and OSS-Fuzz style infrastructure).
+
+   libFuzzer ignores all flags starting with `--`, so the options of the driver are accepted in
+   the form `--load-snapshot=F`, `--max-heartbeats=N`, `--max-memory=MB` and `--max-stack=KB`. */
+
+static StringPool * g_strings = nullptr;
+static lean::environment * g_prelude_env = nullptr;
+static check_budget * g_budget = nullptr;
+
+// libFuzzer treats this section like its edge counters, see `rule_feedback.h`
+__attribute__((section("__libfuzzer_extra_counters")))
+static unsigned char g_rule_map[lean::kernel_rule_map_size];
+
+extern "C" int LLVMFuzzerInitialize(int * argc, char *** argv) {
+    initialize_runtime();
+
+    std::string load_snapshot_fname;
+    g_budget = new check_budget();
+    for (int i = 1; i < *argc; ++i) {
+        std::string arg = (*argv)[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            continue;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        char * option[2] = { key.data(), value.data() };
+        if (key == "--load-snapshot") {
+            load_snapshot_fname = value;
+        } else if (g_budget->parse_arg(2, option, 0) == 0) {
+            std::cout << "Unknown option " << key << std::endl;
+        }
+    }
+
+    g_strings = new StringPool(read_strings());
+    lean::optional<lean::elab_environment> prelude_env = load_prelude(read_prelude().text(), load_snapshot_fname);
+    if (!prelude_env || !lean_is_persistent(prelude_env->raw())) {
+        std::cout << "Failed to set up the prelude environment" << std::endl;
+        exit(setup_error_exit_code);
+    }
+    // See `check_testcase`
+    g_prelude_env = new lean::environment(prelude_env->to_kernel_env());
+    print_startup_profile();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t * data, size_t size) {
+    lean::scope_kernel_rule_map rule_scope(g_rule_map);
+
+    if (check_in_iteration_heap(data, size, *g_strings, *g_prelude_env, *g_budget) == check_outcome::proof_of_false) {
+        std::cout << "Have a proof of false?!" << std::endl;
+        abort();
+    }
+    return 0;
+}
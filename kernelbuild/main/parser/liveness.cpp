@@ -0,0 +1,191 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "liveness.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+static size_t table_index(parser_table table) {
+    return static_cast<size_t>(table);
+}
+
+static size_t map_index(parser_table map) {
+    return map == parser_table::constructors ? 0 : 1;
+}
+
+TableLiveness::TableLiveness() :
+        record(0),
+        added_now(0),
+        next_record(0),
+        live(0) {
+    last_use[table_index(parser_table::names)].push_back(no_slot);
+    last_use[table_index(parser_table::levels)].push_back(no_slot);
+    // The anonymous name, which has no parent
+    name_nodes.insert({ name_node{ no_slot, false, 0, std::string_view() }, 0 });
+    name_keys.push_back(0);
+}
+
+size_t TableLiveness::size(parser_table table) const {
+    return last_use[table_index(table)].size();
+}
+
+void TableLiveness::add(parser_table table) {
+    // Dead right away, unless a later record uses it
+    last_use[table_index(table)].push_back(record);
+    ++added_now;
+}
+
+void TableLiveness::add_name(std::uint32_t key) {
+    add(parser_table::names);
+    name_keys.push_back(key);
+}
+
+void TableLiveness::use(parser_table table, std::uint64_t slot) {
+    vector<std::uint32_t> & uses = last_use[table_index(table)];
+    if (slot < uses.size() && uses[slot] != no_slot) {
+        uses[slot] = record;
+    }
+}
+
+void TableLiveness::use_back(parser_table table) {
+    size_t n = size(table);
+    if (n > 0) {
+        use(table, n - 1);
+    }
+}
+
+std::uint32_t TableLiveness::key_of(std::uint64_t slot) const {
+    return name_keys[slot];
+}
+
+size_t TableLiveness::name_node_hash::operator()(name_node const & n) const {
+    size_t h = std::hash<std::string_view>()(n.string);
+    h ^= n.number + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= (static_cast<size_t>(n.parent) << 1 | n.numeric) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+std::uint32_t TableLiveness::intern(name_node const & node) {
+    auto [it, inserted] = name_nodes.insert({ node, static_cast<std::uint32_t>(name_nodes.size()) });
+    return it->second;
+}
+
+std::uint32_t TableLiveness::name_key(std::uint32_t parent, std::string_view component) {
+    return intern(name_node{ parent, false, 0, component });
+}
+
+std::uint32_t TableLiveness::name_key(std::uint32_t parent, std::uint64_t component) {
+    return intern(name_node{ parent, true, component, std::string_view() });
+}
+
+void TableLiveness::access(parser_table map, std::uint32_t key, std::uint32_t slot) {
+    // Erasing the key after this record is only sound if the parser still has the name then. The
+    // record reads `slot`, so it is released after this record at the earliest, and maps are
+    // released first.
+    last_access[map_index(map)][key] = map_access{ record, slot };
+}
+
+bool TableLiveness::insert(parser_table map, std::uint32_t key, std::uint32_t slot) {
+    access(map, key, slot);
+    present[map_index(map)].insert(key);
+    return true;
+}
+
+bool TableLiveness::lookup(parser_table map, std::uint32_t key, std::uint32_t slot) {
+    access(map, key, slot);
+    return present[map_index(map)].count(key) > 0;
+}
+
+void TableLiveness::end_record() {
+    added.push_back(added_now);
+    added_now = 0;
+    ++record;
+}
+
+void TableLiveness::finish() {
+    vector<std::uint32_t> & expr_uses = last_use[table_index(parser_table::exprs)];
+    if (!expr_uses.empty()) {
+        expr_uses.back() = no_slot;
+    }
+
+    // Sorted by record with a counting sort, maps before tables within a record
+    release_begin.assign(static_cast<size_t>(record) + 1, 0);
+    for (auto const & accesses : last_access) {
+        for (auto const & [key, a] : accesses) {
+            ++release_begin[a.record + 1];
+        }
+    }
+    for (auto const & uses : last_use) {
+        for (std::uint32_t r : uses) {
+            if (r < record) {
+                ++release_begin[r + 1];
+            }
+        }
+    }
+    for (size_t r = 1; r < release_begin.size(); ++r) {
+        release_begin[r] += release_begin[r - 1];
+    }
+    releases.resize(release_begin.back());
+    vector<std::uint64_t> fill(release_begin.begin(), release_begin.end() - 1);
+    parser_table maps[2] = { parser_table::constructors, parser_table::inductives };
+    for (size_t m = 0; m < 2; ++m) {
+        for (auto const & [key, a] : last_access[m]) {
+            releases[fill[a.record]++] = release{ maps[m], a.slot };
+        }
+    }
+    for (size_t t = 0; t < 3; ++t) {
+        for (size_t slot = 0; slot < last_use[t].size(); ++slot) {
+            std::uint32_t r = last_use[t][slot];
+            if (r < record) {
+                releases[fill[r]++] = release{ static_cast<parser_table>(t), static_cast<std::uint32_t>(slot) };
+            }
+        }
+    }
+
+    // Only needed for scanning
+    for (size_t t = 0; t < 3; ++t) {
+        vector<std::uint32_t>().swap(last_use[t]);
+    }
+    vector<std::uint32_t>().swap(name_keys);
+    decltype(name_nodes)().swap(name_nodes);
+    for (size_t m = 0; m < 2; ++m) {
+        lean::unordered_set<std::uint32_t>().swap(present[m]);
+        lean::unordered_map<std::uint32_t, map_access>().swap(last_access[m]);
+    }
+}
+
+void TableLiveness::release_record(std::function<void(release const &)> const & f) {
+    if (next_record + 1 >= release_begin.size()) {
+        return;
+    }
+    size_t released = 0;
+    for (std::uint64_t i = release_begin[next_record]; i < release_begin[next_record + 1]; ++i) {
+        f(releases[i]);
+        if (releases[i].table != parser_table::constructors && releases[i].table != parser_table::inductives) {
+            ++released;
+        }
+    }
+    stats.slots += added[next_record];
+    stats.released += released;
+    live += added[next_record] - released;
+    stats.peak_live = std::max(stats.peak_live, live);
+    ++next_record;
+}
+
+const liveness_stats & TableLiveness::get_stats() const {
+    return stats;
+}
+
+bool table_liveness_enabled() {
+    return getenv("FUZZ_TABLE_LIVENESS") != nullptr;
+}
+
+void print_liveness_stats(char const * what, liveness_stats const & stats) {
+    std::cout << what << ": " << stats.released << " of " << stats.slots << " table entries released, at most "
+              << stats.peak_live << " alive at once" << std::endl;
+}
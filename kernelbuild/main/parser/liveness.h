@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "util/alloc.h"
+
+/* Releasing table entries of `BinParser` after their last use.
+
+   The parser keeps every name, level and expression in a table, because any later record may
+   refer to it by index, and constructors and inductive types in maps until an inductive
+   declaration refers to them by name. All of it stays alive until the parser is destroyed.
+
+   With liveness enabled, the parser first scans the input without building objects and tells a
+   `TableLiveness` what every record adds to the tables and reads from them. This gives the last
+   record that reads each entry. While parsing for real, the parser then asks after each record
+   which entries are dead, and overwrites them with cheap placeholders (table sizes, and with them
+   the meaning of indices, do not change) or erases them from the maps. The last expression is
+   kept, because `add_false` uses it.
+
+   This only drops the parser's references. Whatever a checked declaration contains stays alive in
+   the environment, and in an export every expression is part of some declaration, so exports gain
+   little; what is freed are entries no declaration uses, as in fuzzed inputs. The statistics
+   count entries, not bytes: compare the peak RSS with and without liveness (`FUZZ_REPORT_MEMORY`)
+   for the memory it saves. The text parser has no scan, since the prelude and text exports are
+   checked in full anyway.
+
+   Map keys are names, which may be built more than once under different indices, so the scan
+   identifies names by their structure: every distinct name gets a key from `name_key`. */
+
+enum class parser_table : std::uint8_t { names, levels, exprs, constructors, inductives };
+
+struct liveness_stats {
+    // Table entries added and released so far
+    size_t slots = 0;
+    size_t released = 0;
+    // Most entries alive after a record
+    size_t peak_live = 0;
+};
+
+class TableLiveness {
+public:
+    template<typename T> using vector = std::vector<T, lean::allocator<T>>;
+
+    static constexpr std::uint32_t no_slot = UINT32_MAX;
+
+    // Both tables of names and levels start with one entry, which is never released
+    TableLiveness();
+
+    /* Scanning. Calls describe the records in input order, ending each with `end_record`. */
+
+    size_t size(parser_table table) const;
+    void add(parser_table table);
+    // Adds a name with the given key, see `name_key`
+    void add_name(std::uint32_t key);
+    // Ignored if `slot` is out of range, the parser reports an error then
+    void use(parser_table table, std::uint64_t slot);
+    // Uses the last entry of the table, if there is one
+    void use_back(parser_table table);
+
+    // The key of the name in `slot`, which must be in range
+    std::uint32_t key_of(std::uint64_t slot) const;
+    // Keys of names by parent and last component. The anonymous name has key 0.
+    std::uint32_t name_key(std::uint32_t parent, std::string_view component);
+    std::uint32_t name_key(std::uint32_t parent, std::uint64_t component);
+
+    // Inserts `key` into a map (without replacing an entry that is there already), or looks it
+    // up. `slot` is the entry of the names table the record built the key from, `no_slot` if
+    // it is not from the table. Returns whether the key is in the map afterwards.
+    bool insert(parser_table map, std::uint32_t key, std::uint32_t slot);
+    bool lookup(parser_table map, std::uint32_t key, std::uint32_t slot);
+
+    void end_record();
+
+    // Computes the releases, after the last record
+    void finish();
+
+    /* Parsing */
+
+    struct release {
+        parser_table table;
+        // For maps, the entry of the names table with the key, or `no_slot`
+        std::uint32_t slot;
+    };
+
+    // Calls `f` on the entries that are dead after the next record, maps first, and moves on to
+    // the following record
+    void release_record(std::function<void(release const &)> const & f);
+
+    const liveness_stats & get_stats() const;
+
+private:
+    struct name_node {
+        std::uint32_t parent;
+        bool numeric;
+        std::uint64_t number;
+        std::string_view string;
+
+        bool operator==(name_node const & other) const {
+            return parent == other.parent && numeric == other.numeric && number == other.number &&
+                   string == other.string;
+        }
+    };
+    struct name_node_hash {
+        size_t operator()(name_node const & n) const;
+    };
+    struct map_access {
+        std::uint32_t record;
+        std::uint32_t slot;
+    };
+
+    std::uint32_t intern(name_node const & node);
+    void access(parser_table map, std::uint32_t key, std::uint32_t slot);
+
+    /* Scanning */
+    std::uint32_t record;
+    // By table: the last record that uses each entry, or `no_slot` to keep it
+    vector<std::uint32_t> last_use[3];
+    vector<std::uint32_t> name_keys;
+    lean::unordered_map<name_node, std::uint32_t, name_node_hash> name_nodes;
+    // By map: the keys in it, and the last record that accessed each key
+    lean::unordered_set<std::uint32_t> present[2];
+    lean::unordered_map<std::uint32_t, map_access> last_access[2];
+    // Entries of the tables added by each record, and by the current one
+    vector<std::uint32_t> added;
+    std::uint32_t added_now;
+
+    /* Releases, by record */
+    vector<std::uint64_t> release_begin;
+    vector<release> releases;
+
+    /* Parsing */
+    std::uint32_t next_record;
+    size_t live;
+    liveness_stats stats;
+};
+
+// True if the environment variable `FUZZ_TABLE_LIVENESS` is set
+bool table_liveness_enabled();
+
+// Prints `stats` on one line, prefixed with `what`
+void print_liveness_stats(char const * what, liveness_stats const & stats);
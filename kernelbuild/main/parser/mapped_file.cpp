@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Smallest mapping for which huge pages are requested, one huge page on x86-64
+static constexpr size_t huge_page_size = static_cast<size_t>(2) * 1024 * 1024;
+
+static std::filesystem::filesystem_error file_error(const char * what, const std::string & fname, int err) {
+    return std::filesystem::filesystem_error(what, fname, std::error_code(err, std::generic_category()));
+}
+
+MappedFile::MappedFile() : mem(nullptr), length(0) {}
+
+MappedFile::MappedFile(const std::string & fname) : mem(nullptr), length(0) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw file_error("cannot open", fname, errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw file_error("cannot stat", fname, err);
+    }
+    // `mmap` rejects empty mappings, and an empty file needs none
+    if (st.st_size > 0) {
+        void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            throw file_error("cannot map", fname, err);
+        }
+        mem = addr;
+        length = st.st_size;
+        madvise(mem, length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        if (length >= huge_page_size) {
+            madvise(mem, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (mem != nullptr) {
+        munmap(mem, length);
+    }
+}
+
+MappedFile::MappedFile(MappedFile && other) : mem(other.mem), length(other.length) {
+    other.mem = nullptr;
+    other.length = 0;
+}
+
+MappedFile & MappedFile::operator=(MappedFile && other) {
+    std::swap(mem, other.mem);
+    std::swap(length, other.length);
+    return *this;
+}
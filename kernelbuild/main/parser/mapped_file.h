@@ -0,0 +1,39 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* A read-only, private mapping of a whole file.
+
+   Both parsers take a view of their input, so a mapped file is parsed straight from the page
+   cache, without copying it into a buffer first. The mapping is advised `MADV_SEQUENTIAL`, since
+   the parsers read it front to back, and `MADV_HUGEPAGE` if it is large enough for that to help
+   (this needs `CONFIG_READ_ONLY_THP_FOR_FS` for files and is only a hint). */
+class MappedFile {
+public:
+    // An empty file
+    MappedFile();
+    // Throws `std::filesystem::filesystem_error` if `fname` cannot be opened or mapped.
+    explicit MappedFile(const std::string & fname);
+    ~MappedFile();
+
+    MappedFile(MappedFile && other);
+    MappedFile & operator=(MappedFile && other);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const std::uint8_t * data() const { return static_cast<const std::uint8_t *>(mem); }
+    size_t size() const { return length; }
+    std::string_view text() const { return std::string_view(static_cast<const char *>(mem), length); }
+
+private:
+    void * mem;
+    size_t length;
+};
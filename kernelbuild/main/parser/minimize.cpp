@@ -0,0 +1,191 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "minimize.h"
+#include "binparser.h"
+#include "binformat.h"
+#include "binrecord.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Minimizer {
+public:
+    Minimizer(StringPool const & _strings, lean::environment const & _prelude_env,
+              check_budget const & _budget) :
+            strings(_strings),
+            prelude_env(_prelude_env),
+            budget(_budget),
+            probes(0) {}
+
+    // Sets the signature to preserve. Returns false if there is nothing to preserve.
+    bool set_target(std::vector<bin_record> const & records) {
+        target = forked_signature(encode_records(records));
+        return target != outcome_name(check_outcome::accepted);
+    }
+
+    std::string const & get_target() const {
+        return target;
+    }
+
+    size_t get_probes() const {
+        return probes;
+    }
+
+    bool preserves_target(std::vector<bin_record> const & records) {
+        std::vector<std::uint8_t> data = encode_records(records);
+        ++probes;
+        // Even if the original testcase does not crash, a reduced one may, and that must not take
+        // the minimizer down with it. The prelude is loaded already, so a fork is cheap.
+        return forked_signature(data) == target;
+    }
+
+private:
+    std::string signature(std::vector<std::uint8_t> const & data) {
+        iteration_stats stats;
+        check_outcome outcome = check_in_iteration_heap(data.data(), data.size(), strings, prelude_env, budget,
+                                                        false, &stats);
+        return outcome_signature(outcome, stats);
+    }
+
+    std::string forked_signature(std::vector<std::uint8_t> const & data) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return "pipe failed";
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return "fork failed";
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            std::string sig = signature(data);
+            ssize_t written = write(fds[1], sig.data(), sig.size());
+            _exit(written == static_cast<ssize_t>(sig.size()) ? 0 : 1);
+        }
+        close(fds[1]);
+        std::string sig;
+        char buf[256];
+        ssize_t n;
+        while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+            sig.append(buf, n);
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (WIFSIGNALED(status)) {
+            return "signal " + std::to_string(WTERMSIG(status));
+        }
+        return sig;
+    }
+
+    StringPool const & strings;
+    lean::environment const & prelude_env;
+    check_budget const & budget;
+
+    std::string target;
+    size_t probes;
+};
+
+// Removes chunks of records, halving the chunk size whenever no chunk can be removed (ddmin)
+static void remove_records(Minimizer & m, std::vector<bin_record> & records) {
+    size_t n = 2;
+    while (records.size() >= 2) {
+        size_t chunk = (records.size() + n - 1) / n;
+        bool reduced = false;
+        for (size_t start = 0; start < records.size(); start += chunk) {
+            std::vector<bool> keep(records.size(), true);
+            std::fill(keep.begin() + start, keep.begin() + std::min(start + chunk, records.size()), false);
+            std::vector<bin_record> candidate = select_records(records, keep);
+            if (m.preserves_target(candidate)) {
+                records = std::move(candidate);
+                n = std::max<size_t>(n - 1, 2);
+                reduced = true;
+                break;
+            }
+        }
+        if (!reduced) {
+            if (n >= records.size()) {
+                break;
+            }
+            n = std::min(n * 2, records.size());
+        }
+    }
+}
+
+// Points references to the first entry of their table and empties literals
+static void simplify_records(Minimizer & m, std::vector<bin_record> & records) {
+    for (size_t r = 0; r < records.size(); ++r) {
+        for (size_t i = 0; i < records[r].refs.size(); ++i) {
+            if (records[r].refs[i].index == 0) {
+                continue;
+            }
+            std::uint32_t old_index = records[r].refs[i].index;
+            records[r].refs[i].index = 0;
+            if (!m.preserves_target(records)) {
+                records[r].refs[i].index = old_index;
+            }
+        }
+
+        bin_record & rec = records[r];
+        bool literal = rec.kind == bin_record_kind::Expr && rec.bytes.size() > 3
+                       && (rec.bytes[1] % 10 == 8 || rec.bytes[1] % 10 == 9);
+        if (literal) {
+            std::vector<std::uint8_t> old_bytes = rec.bytes;
+            rec.bytes = { old_bytes[0], old_bytes[1], 0 };
+            if (!m.preserves_target(records)) {
+                rec.bytes = std::move(old_bytes);
+            }
+        }
+    }
+}
+
+int run_minimize(std::string const & input, std::string output, StringPool const & strings,
+                 lean::environment const & prelude_env, check_budget const & budget) {
+    if (output.empty()) {
+        output = input + "-min";
+    }
+    MappedFile data;
+    try {
+        data = MappedFile(input);
+    } catch (const std::filesystem::filesystem_error & ex) {
+        std::cout << input << ": " << ex.code().message() << std::endl;
+        return setup_error_exit_code;
+    }
+    const std::uint8_t * buf = data.data();
+    std::uint64_t len = data.size();
+    if (read_bin_header(buf, len).version != 1) {
+        std::cout << "Only version 1 of the binary format can be minimized" << std::endl;
+        return setup_error_exit_code;
+    }
+    std::vector<bin_record> records = decode_records(data.data(), data.size());
+    size_t original_records = records.size();
+
+    Minimizer m(strings, prelude_env, budget);
+    if (!m.set_target(records)) {
+        std::cout << "Testcase is accepted, nothing to minimize" << std::endl;
+        return setup_error_exit_code;
+    }
+    std::cout << "Preserving: " << m.get_target() << std::endl;
+
+    remove_records(m, records);
+    simplify_records(m, records);
+
+    std::vector<std::uint8_t> result = encode_records(records);
+    std::ofstream out(output, std::ios_base::binary);
+    out.write(reinterpret_cast<char const *>(result.data()), result.size());
+
+    std::cout << "Minimized " << data.size() << " bytes (" << original_records << " records) to "
+              << result.size() << " bytes (" << records.size() << " records) in " << m.get_probes()
+              << " checks, written to " << output << std::endl;
+    return 0;
+}
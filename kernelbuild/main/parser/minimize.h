@@ -0,0 +1,25 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "kernel/environment.h"
+
+/* In-process testcase minimizer.
+
+   Delta debugging at the granularity of records (see `binrecord.h`) rather than bytes: records are
+   removed in chunks and then one by one, references of the remaining records are renumbered, and
+   literals are shortened, as long as the failure signature stays the same. The signature is the
+   outcome of `check_testcase`, including the type of the kernel exception, or the signal if
+   checking the testcase crashes. Every candidate is checked in a forked child of the process that
+   loaded the prelude environment, so a candidate that crashes cannot take the minimizer down. */
+
+// Minimizes `input` and writes the result to `output` (default: `input` with `-min` appended).
+// Returns `setup_error_exit_code` if the input cannot be read or is accepted, and 0 otherwise.
+int run_minimize(std::string const & input, std::string output, StringPool const & strings,
+                 lean::environment const & prelude_env, check_budget const & budget);
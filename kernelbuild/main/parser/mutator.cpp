@@ -0,0 +1,369 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "binrecord.h"
+#include "binformat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+
+/* AFL++ custom mutator for the binary format.
+
+   Byte-level mutations of testcases mostly hit the `% size()` fallbacks of `BinParser` or break
+   the record structure. This mutator works on records (see `binrecord.h`) instead: it deletes,
+   inserts, splices and retargets whole records and keeps all back-references in range, and it
+   changes name components to other entries of the `strings` table. `afl_custom_post_process`
+   normalizes every testcase the same way, so byte-level mutations of other stages end up with
+   in-range references too.
+
+   Records are only understood in version 1 of the format. Inputs with the version 2 header (see
+   `binformat.h`) are left to AFL's own mutations: `afl_custom_fuzz` produces nothing for them and
+   `afl_custom_post_process` passes them through unchanged.
+
+   Load it with `AFL_CUSTOM_MUTATOR_LIBRARY=./libmutator.so`. The string table is read from the file
+   in `AFL_CUSTOM_MUTATOR_STRINGS`, or `strings` in the working directory. */
+
+struct afl_state;
+
+struct Mutator {
+    std::mt19937 rng;
+    std::uint32_t num_strings;
+    std::vector<std::uint8_t> fuzz_buf;
+    std::vector<std::uint8_t> post_process_buf;
+
+    size_t random(size_t bound) {
+        return bound == 0 ? 0 : std::uniform_int_distribution<size_t>(0, bound - 1)(rng);
+    }
+};
+
+static std::uint32_t count_strings(char const * fname) {
+    std::ifstream in(fname);
+    std::string line;
+    std::uint32_t result = 0;
+    while (std::getline(in, line)) {
+        ++result;
+    }
+    return result;
+}
+
+// Sizes of the tables just before record `pos`
+static void table_sizes(std::vector<bin_record> const & records, size_t pos, std::uint32_t * sizes) {
+    for (size_t i = 0; i < num_bin_tables; ++i) {
+        sizes[i] = initial_table_size(static_cast<bin_table>(i));
+    }
+    for (size_t r = 0; r < pos && r < records.size(); ++r) {
+        bin_table table;
+        if (records[r].defines(table)) {
+            sizes[static_cast<size_t>(table)]++;
+        }
+    }
+}
+
+/* Builds a random record whose references are in range for the given table sizes */
+class RecordWriter {
+public:
+    RecordWriter(Mutator & _m, std::uint32_t const * _sizes) :
+            m(_m),
+            sizes(_sizes) {}
+
+    bin_record write(bin_record_kind kind) {
+        rec = bin_record();
+        rec.kind = kind;
+        u8(static_cast<std::uint8_t>(kind));
+        switch (kind) {
+            case bin_record_kind::Level: {
+                std::uint8_t levelType = m.random(4);
+                u8(levelType);
+                if (levelType == 3) {
+                    ref(bin_table::Name);
+                } else {
+                    ref(bin_table::Level);
+                    if (levelType != 0) {
+                        ref(bin_table::Level);
+                    }
+                }
+                break;
+            }
+            case bin_record_kind::Expr:
+                expression();
+                break;
+            case bin_record_kind::Definition: {
+                ref(bin_table::Name);
+                ref(bin_table::Expr);
+                ref(bin_table::Expr);
+                std::uint8_t hintType = m.random(3);
+                u8(hintType);
+                if (hintType == 2) {
+                    u16(0);
+                    u16(m.random(16));
+                }
+                refs(bin_table::Name, 2);
+                break;
+            }
+            case bin_record_kind::Theorem:
+                ref(bin_table::Name);
+                ref(bin_table::Expr);
+                ref(bin_table::Expr);
+                refs(bin_table::Name, 2);
+                break;
+            case bin_record_kind::Inductive:
+                ref(bin_table::Name);
+                ref(bin_table::Expr);
+                refs(bin_table::Name, 3);
+                break;
+            case bin_record_kind::InductiveFamily:
+                u8(m.random(4));
+                refs(bin_table::Name, 2);
+                refs(bin_table::Name, 2);
+                break;
+            case bin_record_kind::Constructor:
+                ref(bin_table::Name);
+                ref(bin_table::Expr);
+                break;
+            case bin_record_kind::Name: {
+                std::uint8_t nameType = m.random(2);
+                u8(nameType);
+                ref(bin_table::Name);
+                u16(nameType == 0 ? m.random(m.num_strings) : m.random(4));
+                break;
+            }
+        }
+        return rec;
+    }
+
+private:
+    void u8(std::uint8_t v) {
+        rec.bytes.push_back(v);
+    }
+
+    void u16(std::uint16_t v) {
+        u8(v >> 8);
+        u8(v & 0xff);
+    }
+
+    void ref(bin_table table) {
+        rec.refs.push_back({ static_cast<std::uint32_t>(rec.bytes.size()), table,
+                             static_cast<std::uint32_t>(m.random(sizes[static_cast<size_t>(table)])) });
+        u16(0);
+    }
+
+    void refs(bin_table table, size_t max_amt) {
+        size_t amt = m.random(max_amt + 1);
+        u8(amt);
+        for (size_t i = 0; i < amt; ++i) {
+            ref(table);
+        }
+    }
+
+    void expression() {
+        std::uint8_t expressionType = m.random(10);
+        u8(expressionType);
+        switch (expressionType) {
+            case 0: u16(m.random(4)); break;
+            case 1: ref(bin_table::Level); break;
+            case 2: ref(bin_table::Name); refs(bin_table::Level, 2); break;
+            case 3: ref(bin_table::Expr); ref(bin_table::Expr); break;
+            case 4:
+            case 5: ref(bin_table::Name); ref(bin_table::Expr); ref(bin_table::Expr); break;
+            case 6: ref(bin_table::Name); ref(bin_table::Expr); ref(bin_table::Expr); ref(bin_table::Expr); break;
+            case 7: ref(bin_table::Name); u16(m.random(4)); ref(bin_table::Expr); break;
+            case 8: {
+                size_t len = m.random(9);
+                u8(len);
+                for (size_t i = 0; i < len; ++i) u8(m.random(256));
+                break;
+            }
+            case 9: {
+                size_t len = m.random(5);
+                u8(len);
+                for (size_t i = 0; i < len; ++i) u8('a' + m.random(26));
+                break;
+            }
+        }
+    }
+
+    Mutator & m;
+    std::uint32_t const * sizes;
+    bin_record rec;
+};
+
+// Inserts `inserted` before record `pos`. References of `inserted` must be valid at `pos`, and
+// are shifted if they point to records within `inserted`.
+static void insert_records(std::vector<bin_record> & records, size_t pos, std::vector<bin_record> inserted) {
+    std::uint32_t before[num_bin_tables];
+    table_sizes(records, pos, before);
+    std::uint32_t added[num_bin_tables] = {};
+    for (bin_record const & rec : inserted) {
+        bin_table table;
+        if (rec.defines(table)) {
+            added[static_cast<size_t>(table)]++;
+        }
+    }
+    // Later records keep pointing to the same entries. Expression references made while the table
+    // is still empty mean `Prop` and are left alone.
+    std::uint32_t sizes[num_bin_tables];
+    std::copy(before, before + num_bin_tables, sizes);
+    for (size_t r = pos; r < records.size(); ++r) {
+        for (bin_ref & ref : records[r].refs) {
+            size_t t = static_cast<size_t>(ref.table);
+            if (ref.index >= before[t] && sizes[t] > 0) {
+                ref.index += added[t];
+            }
+        }
+        bin_table table;
+        if (records[r].defines(table)) {
+            sizes[static_cast<size_t>(table)]++;
+        }
+    }
+    records.insert(records.begin() + pos, inserted.begin(), inserted.end());
+}
+
+// Points a random reference of a random record to another entry of the same table
+static void retarget(Mutator & m, std::vector<bin_record> & records) {
+    size_t r = m.random(records.size());
+    if (records[r].refs.empty()) {
+        return;
+    }
+    bin_ref & ref = records[r].refs[m.random(records[r].refs.size())];
+    std::uint32_t sizes[num_bin_tables];
+    table_sizes(records, r, sizes);
+    ref.index = m.random(sizes[static_cast<size_t>(ref.table)]);
+}
+
+// Changes the string component of a random name to another entry of `strings`
+static void swap_name(Mutator & m, std::vector<bin_record> & records) {
+    std::vector<size_t> candidates;
+    for (size_t r = 0; r < records.size(); ++r) {
+        if (records[r].kind == bin_record_kind::Name && records[r].bytes[1] % 2 == 0) {
+            candidates.push_back(r);
+        }
+    }
+    if (candidates.empty() || m.num_strings == 0) {
+        return;
+    }
+    bin_record & rec = records[candidates[m.random(candidates.size())]];
+    std::uint16_t idx = m.random(m.num_strings);
+    rec.bytes[4] = idx >> 8;
+    rec.bytes[5] = idx & 0xff;
+}
+
+// Inserts a run of records from `other` at a random position. References within the run keep
+// their targets, references before the run are pointed to random entries at the insertion point.
+static void splice(Mutator & m, std::vector<bin_record> & records, std::vector<bin_record> const & other) {
+    if (other.empty()) {
+        return;
+    }
+    size_t start = m.random(other.size());
+    size_t end = start + 1 + m.random(std::min<size_t>(other.size() - start, 16));
+    std::uint32_t other_before[num_bin_tables];
+    table_sizes(other, start, other_before);
+
+    size_t pos = m.random(records.size() + 1);
+    std::uint32_t sizes[num_bin_tables];
+    table_sizes(records, pos, sizes);
+
+    std::vector<bin_record> run(other.begin() + start, other.begin() + end);
+    for (bin_record & rec : run) {
+        for (bin_ref & ref : rec.refs) {
+            size_t t = static_cast<size_t>(ref.table);
+            if (ref.index >= other_before[t]) {
+                ref.index = ref.index - other_before[t] + sizes[t];
+            } else {
+                ref.index = m.random(sizes[t]);
+            }
+        }
+    }
+    insert_records(records, pos, std::move(run));
+}
+
+static void mutate(Mutator & m, std::vector<bin_record> & records, std::vector<bin_record> const & other) {
+    switch (records.empty() ? 1 : m.random(6)) {
+        case 0: {
+            std::vector<bool> keep(records.size(), true);
+            keep[m.random(records.size())] = false;
+            records = select_records(records, keep);
+            break;
+        }
+        case 1: {
+            size_t pos = m.random(records.size() + 1);
+            std::uint32_t sizes[num_bin_tables];
+            table_sizes(records, pos, sizes);
+            bin_record rec = RecordWriter(m, sizes).write(static_cast<bin_record_kind>(m.random(8)));
+            insert_records(records, pos, { rec });
+            break;
+        }
+        case 2:
+            splice(m, records, other);
+            break;
+        case 3:
+        case 4:
+            retarget(m, records);
+            break;
+        case 5:
+            swap_name(m, records);
+            break;
+    }
+}
+
+static bool is_version_1(const std::uint8_t * buf, size_t len) {
+    std::uint64_t remaining = len;
+    return read_bin_header(buf, remaining).version == 1;
+}
+
+static size_t output(std::vector<std::uint8_t> & out_buf, std::vector<bin_record> const & records,
+                     size_t max_size, std::uint8_t ** out) {
+    out_buf = encode_records(records);
+    if (out_buf.size() > max_size) {
+        out_buf.resize(max_size);
+    }
+    *out = out_buf.data();
+    return out_buf.size();
+}
+
+extern "C" void * afl_custom_init(afl_state *, unsigned int seed) {
+    Mutator * m = new Mutator();
+    m->rng.seed(seed);
+    char const * strings = getenv("AFL_CUSTOM_MUTATOR_STRINGS");
+    m->num_strings = count_strings(strings ? strings : "strings");
+    return m;
+}
+
+extern "C" size_t afl_custom_fuzz(void * data, std::uint8_t * buf, size_t buf_size, std::uint8_t ** out_buf,
+                                  std::uint8_t * add_buf, size_t add_buf_size, size_t max_size) {
+    Mutator & m = *static_cast<Mutator *>(data);
+    if (!is_version_1(buf, buf_size)) {
+        // AFL skips the execution when nothing is returned
+        *out_buf = buf;
+        return 0;
+    }
+    std::vector<bin_record> records = decode_records(buf, buf_size);
+    std::vector<bin_record> other;
+    if (add_buf && is_version_1(add_buf, add_buf_size)) {
+        other = decode_records(add_buf, add_buf_size);
+    }
+    // Stack a few mutations, like AFL's havoc stage
+    size_t rounds = 1 + m.random(4);
+    for (size_t i = 0; i < rounds; ++i) {
+        mutate(m, records, other);
+    }
+    return output(m.fuzz_buf, records, max_size, out_buf);
+}
+
+extern "C" size_t afl_custom_post_process(void * data, std::uint8_t * buf, size_t buf_size, std::uint8_t ** out_buf) {
+    Mutator & m = *static_cast<Mutator *>(data);
+    if (!is_version_1(buf, buf_size)) {
+        *out_buf = buf;
+        return buf_size;
+    }
+    return output(m.post_process_buf, decode_records(buf, buf_size), SIZE_MAX, out_buf);
+}
+
+extern "C" void afl_custom_deinit(void * data) {
+    delete static_cast<Mutator *>(data);
+}
@@ -6,7 +6,13 @@ Author: Markus Himmel
 */
 #include "parser.h"
 
+#include <algorithm>
 #include <charconv>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <thread>
 
 #define MARKUS_DEBUG
 
@@ -20,26 +26,20 @@ namespace sz = ashvardanian::stringzilla;
 using sz::literals::operator""_sz;
 
 sz::string_view Parser::try_parse_string() {
-    line = line.lstrip(sz::whitespaces_set());
-    if (line.empty()) {
-        return line;
+    if (token == tokens_end) {
+        return sz::string_view();
     } else {
-        auto [val, _, rest] = line.partition(" ");
-        line = rest;
-        return val;
+        return (token++)->text();
     }
 }
 
 sz::string_view Parser::parse_string() {
-    line = line.lstrip(sz::whitespaces_set());
-    if (line.empty()) {
+    if (token == tokens_end) {
         dbgf("Nothing to read\n");
         error = true;
-        return line;
+        return sz::string_view();
     } else {
-        auto [val, _, rest] = line.partition(" ");
-        line = rest;
-        return val;
+        return (token++)->text();
     }
 }
 
@@ -83,25 +83,34 @@ T Parser::convert_numeric(sz::string_view val) {
     }
 }
 
+// Numbers were converted while tokenizing, `convert_numeric` only sees the rest, to report errors
+template<typename T>
+T Parser::convert_token(const text_token & t) {
+    if (t.numeric && t.value <= std::numeric_limits<T>::max()) {
+        return static_cast<T>(t.value);
+    }
+    return convert_numeric<T>(t.text());
+}
+
 template<typename T>
 T Parser::parse_numeric() {
-    auto val = parse_string();
-    if (error) return 0;
-    auto result = convert_numeric<T>(val);
-    return result;
+    if (token == tokens_end) {
+        dbgf("Nothing to read\n");
+        error = true;
+        return 0;
+    }
+    return convert_token<T>(*token++);
 }
 
 template <typename T>
 std::vector<T> Parser::parse_numeric_star() {
     std::vector<T> result;
-    auto val = try_parse_string();
-    while (!val.empty()) {
-        auto num = convert_numeric<T>(val);
+    while (token != tokens_end) {
+        auto num = convert_token<T>(*token++);
         if (error) {
             return result;
         }
         result.push_back(num);
-        val = try_parse_string();
     }
     return result;
 }
@@ -166,9 +175,8 @@ lean::level Parser::parse_level_idx() {
 template<typename T>
 std::vector<T> Parser::parse_obj_star(const std::vector<T> & objs) {
     std::vector<T> result;
-    auto val = try_parse_string();
-    while (!val.empty()) {
-        auto num = convert_numeric<std::uint64_t>(val);
+    while (token != tokens_end) {
+        auto num = convert_token<std::uint64_t>(*token++);
         if (error) {
             return std::vector<T>();
         }
@@ -178,7 +186,6 @@ std::vector<T> Parser::parse_obj_star(const std::vector<T> & objs) {
             return std::vector<T>();
         }
         result.push_back(objs[num]);
-        val = try_parse_string();
     }
     return result;
 }
@@ -307,32 +314,40 @@ sz::string_view universe_max = "#UM"_sz;
 sz::string_view universe_imax = "#UIM"_sz;
 sz::string_view universe_parameter = "#UP"_sz;
 
+void Parser::push_level(lean::level const & l) {
+    levels.push_back(share_terms ? sharing.share(l) : l);
+}
+
+void Parser::push_expr(lean::expr const & e) {
+    exprs.push_back(share_terms ? sharing.share(e) : e);
+}
+
 void Parser::parse_level() {
     auto type = parse_string();
     if (type == universe_succ) {
         auto parent = parse_level_idx();
         if (error) return;
         lean::level l = lean::mk_succ(parent);
-        levels.push_back(l);
+        push_level(l);
     } else if (type == universe_max) {
         auto lhs = parse_level_idx();
         if (error) return;
         auto rhs = parse_level_idx();
         if (error) return;
         lean::level l = lean::mk_max(lhs, rhs);
-        levels.push_back(l);
+        push_level(l);
     } else if (type == universe_imax) {
         auto lhs = parse_level_idx();
         if (error) return;
         auto rhs = parse_level_idx();
         if (error) return;
         lean::level l = lean::mk_imax(lhs, rhs);
-        levels.push_back(l);
+        push_level(l);
     } else if (type == universe_parameter) {
         auto parameter = parse_name_idx(false);
         if (error) return;
         lean::level l = lean::mk_univ_param(parameter);
-        levels.push_back(l);
+        push_level(l);
     } else {
         dbgf("Unknown universe type\n");
         error = true;
@@ -358,26 +373,26 @@ void Parser::parse_expression() {
         auto deBruijnIndex = parse_u64();
         if (error) return;
         lean::expr e = lean::mk_bvar(lean::nat(deBruijnIndex));
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_sort) {
         auto universe = parse_level_idx();
         if (error) return;
         lean::expr e = lean::mk_sort(universe);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_constant) {
         auto name = parse_name_idx(false);
         if (error) return;
         auto universes = parse_level_star();
         if (error) return;
         lean::expr e = lean::mk_const(name, universes);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_application) {
         auto lhs = parse_expr_idx();
         if (error) return;
         auto rhs = parse_expr_idx();
         if (error) return;
         lean::expr e = lean::mk_app(lhs, rhs);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_lambda) {
         parse_string(); // ignored, we don't care
         if (error) return;
@@ -388,7 +403,7 @@ void Parser::parse_expression() {
         auto body = parse_expr_idx();
         if (error) return;
         lean::expr e = lean::mk_lambda(binderName, binderType, body);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_pi) {
         parse_string(); // ignored, we don't care
         if (error) return;
@@ -399,7 +414,7 @@ void Parser::parse_expression() {
         auto body = parse_expr_idx();
         if (error) return;
         lean::expr e = lean::mk_pi(binderName, binderType, body);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_let) {
         auto binderName = parse_name_idx(false);
         if (error) return;
@@ -410,7 +425,7 @@ void Parser::parse_expression() {
         auto body = parse_expr_idx();
         if (error) return;
         lean::expr e = lean::mk_let(binderName, binderType, boundValue, body);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_projection) {
         auto typeName = parse_name_idx(false);
         if (error) return;
@@ -419,19 +434,19 @@ void Parser::parse_expression() {
         auto value = parse_expr_idx();
         if (error) return;
         lean::expr e = lean::mk_proj(typeName, fieldIndex, value);
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_natlit) {
         auto value = parse_string();
         if (error) return;
         std::string s(value.begin(), value.end());
         lean::mpz num(s.c_str());
         lean::expr e = lean::mk_lit(lean::literal(num));
-        exprs.push_back(e);
+        push_expr(e);
     } else if (type == expression_strlit) {
         auto value = parse_hexstring();
         if (error) return;
         lean::expr e = lean::mk_lit(lean::literal(value.c_str()));
-        exprs.push_back(e);
+        push_expr(e);
     } else {
         dbgf("Unknown expression type\n");
         error = true;
@@ -649,12 +664,86 @@ void Parser::parse_line() {
         return;
     }
     
-    if (!line.empty()) {
+    if (token != tokens_end) {
         dbgf("Not fully consumed\n");
         error = true;
     }
 }
 
+// Parses `len <= 19` ASCII digits, eight at a time. Returns false if one of them is not a digit.
+static bool parse_digits(const char * p, size_t len, std::uint64_t & value) {
+    std::uint64_t result = 0;
+    size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= len; i += 8) {
+        std::uint64_t chunk;
+        std::memcpy(&chunk, p + i, 8);
+        // All bytes are in 0x30..0x39 iff the high nibble is 3 before and after adding 6
+        if ((chunk & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+            ((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL) {
+            return false;
+        }
+        // Combine neighbouring digits to pairs, then to groups of four, then to eight
+        chunk -= 0x3030303030303030ULL;
+        chunk = (chunk * 10) + (chunk >> 8);
+        chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                 (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        result = result * 100000000 + chunk;
+    }
+#endif
+    for (; i < len; ++i) {
+        unsigned digit = static_cast<unsigned char>(p[i]) - '0';
+        if (digit > 9) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    value = result;
+    return true;
+}
+
+// Splits lines into tokens the way `partition(" ")` after stripping whitespace does, which is how
+// the format was parsed before it was tokenized upfront
+Parser::text_chunk Parser::tokenize_chunk(sz::string_view chunk) {
+    text_chunk result;
+    result.tokens.reserve(chunk.size() / 4);
+    for (auto l : chunk.split("\n")) {
+        if (l.empty()) {
+            continue;
+        }
+        result.lines.push_back(l);
+        result.line_tokens.push_back(result.tokens.size());
+        while (true) {
+            l = l.lstrip(sz::whitespaces_set());
+            if (l.empty()) {
+                break;
+            }
+            auto [val, _, rest] = l.partition(" ");
+            text_token t;
+            t.begin = val.data();
+            t.length = static_cast<std::uint32_t>(val.size());
+            t.value = 0;
+            t.numeric = val.size() <= 19 && parse_digits(val.data(), val.size(), t.value);
+            result.tokens.push_back(t);
+            l = rest;
+        }
+    }
+    result.line_tokens.push_back(result.tokens.size());
+    return result;
+}
+
+void Parser::handle_chunk(const text_chunk & chunk) {
+    for (size_t i = 0; i + 1 < chunk.line_tokens.size(); ++i) {
+        full_line = chunk.lines[i];
+        token = chunk.tokens.data() + chunk.line_tokens[i];
+        tokens_end = chunk.tokens.data() + chunk.line_tokens[i + 1];
+        parse_line();
+        if (error) {
+            break;
+        }
+    }
+}
+
 sz::string_view expected_version = "markus-0.0.5\n"_sz;
 
 void Parser::handle_file(sz::string_view file) {
@@ -664,37 +753,83 @@ void Parser::handle_file(sz::string_view file) {
         return;
     }
     file.remove_prefix(expected_version.length());
-    for (auto l : file.split("\n")) {
-        if (!l.empty()) {
-            line = l;
-            full_line = l;
-            parse_line();       
+
+    for_each_chunk(file, [&](const text_chunk & chunk) {
+        handle_chunk(chunk);
+        return !error;
+    });
+}
+
+void Parser::for_each_chunk(sz::string_view file, std::function<bool(const text_chunk &)> const & f) {
+    // Chunks end after a newline, so every line is in exactly one chunk
+    std::vector<sz::string_view> chunks;
+    const char * end = file.data() + file.size();
+    for (const char * begin = file.data(); begin != end;) {
+        const char * split = begin + std::min(chunk_size, static_cast<size_t>(end - begin));
+        if (split != end) {
+            const char * newline = static_cast<const char *>(std::memchr(split, '\n', end - split));
+            split = newline ? newline + 1 : end;
         }
-        if (error) {
-            break;
+        chunks.push_back(sz::string_view(begin, split - begin));
+        begin = split;
+    }
+
+    if (jobs <= 1 || chunks.size() <= 1) {
+        for (sz::string_view chunk : chunks) {
+            if (!f(tokenize_chunk(chunk))) {
+                return;
+            }
+        }
+        return;
+    }
+
+    // At most `jobs` chunks are tokenized ahead of the one being processed, which bounds the
+    // memory for tokens. The threads only see the file, objects are all built on this thread.
+    std::deque<std::future<text_chunk>> pending;
+    size_t next = 0;
+    bool more = true;
+    while (more && (next < chunks.size() || !pending.empty())) {
+        while (next < chunks.size() && pending.size() < jobs) {
+            pending.push_back(std::async(std::launch::async, tokenize_chunk, chunks[next++]));
         }
+        text_chunk chunk = pending.front().get();
+        pending.pop_front();
+        more = f(chunk);
     }
 }
 
+void Parser::set_chunk_size(size_t size) {
+    chunk_size = std::max<size_t>(1, size);
+}
+
 bool Parser::is_error() const {
     return error;
 }
 
-Parser::Parser(bool preludeMode) :
-        line(),
+Parser::Parser(bool preludeMode, unsigned _jobs, bool share) :
+        token(nullptr),
+        tokens_end(nullptr),
         full_line(),
         error(false),
         prelude(preludeMode),
+        jobs(_jobs != 0 ? _jobs : std::max(1u, std::thread::hardware_concurrency())),
+        chunk_size(default_chunk_size),
+        share_terms(share),
         exprs(),
         names(),
         levels(),
         decls(),
         constructors(),
-        inductives() {
+        inductives(),
+        sharing() {
     levels.push_back(lean::mk_level_zero());
     names.push_back(lean::name::anonymous());
 }
 
 const std::vector<lean::declaration> & Parser::get_decls() const {
     return decls;
+}
+
+const sharing_stats & Parser::get_sharing_stats() const {
+    return sharing.get_stats();
 }
\ No newline at end of file
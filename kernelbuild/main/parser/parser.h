@@ -10,30 +10,76 @@ Author: Markus Himmel
 #include "kernel/level.h"
 #include "kernel/declaration.h"
 #include "util/name_hash_map.h"
+#include "expr_sharing.h"
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 namespace sz = ashvardanian::stringzilla;
 
+/* Parser for the text export format.
+
+   Files are parsed in two passes. The first splits the file into chunks at line boundaries and
+   tokenizes them on up to `jobs` threads, converting numeric tokens on the way. The second pass
+   runs on the calling thread and goes through the lines in order, building names, levels and
+   expressions from the indices of earlier lines. Without threads, the chunks are tokenized one at a
+   time on the calling thread, so the tokens of at most `jobs` chunks are alive at once either way.
+   With `share`, structurally equal levels and expressions are built once, see `expr_sharing.h`. */
 class Parser {
 public:
-    Parser(bool preludeMode);
+    // `jobs` is the number of threads tokenizing large files, 0 for one per core.
+    Parser(bool preludeMode, unsigned jobs = 0, bool share = false);
     
+    // `file` must stay alive until this returns.
     void handle_file(sz::string_view file);
 
+    // Tokenizing a chunk takes a few milliseconds, so that the threads are not mostly waiting
+    static constexpr size_t default_chunk_size = static_cast<size_t>(4) * 1024 * 1024;
+    // Splits files into chunks of about `size` bytes instead, for benchmarks on small files
+    void set_chunk_size(size_t size);
+
     bool is_error() const;
 
     const std::vector<lean::declaration> & get_decls() const;
 
+    // All zero unless sharing is enabled
+    const sharing_stats & get_sharing_stats() const;
+
     // Returns false if it was not added.
     bool add_false();
 
 private:
+    struct text_token {
+        const char * begin;
+        std::uint32_t length;
+        // Whether the token is a decimal number below 10^19, which is then in `value`
+        bool numeric;
+        std::uint64_t value;
+
+        sz::string_view text() const { return sz::string_view(begin, length); }
+    };
+
+    struct text_chunk {
+        std::vector<text_token> tokens;
+        // Non-empty lines, and the index of the first token of each in `tokens`, with a final
+        // entry for the end
+        std::vector<sz::string_view> lines;
+        std::vector<std::uint32_t> line_tokens;
+    };
+
+    /* Tokenizing */
+    static text_chunk tokenize_chunk(sz::string_view chunk);
+    // Calls `f` on the chunks of `file` in order, until it returns false
+    void for_each_chunk(sz::string_view file, std::function<bool(const text_chunk &)> const & f);
+    void handle_chunk(const text_chunk & chunk);
+
     /* Basic parsing functions */
     sz::string_view try_parse_string();
     sz::string_view parse_string();
     uint8_t convert_hexchar(sz::string_view val);
     sz::string parse_hexstring();
     template<typename T> T convert_numeric(sz::string_view val);
+    template<typename T> T convert_token(const text_token & token);
     template<typename T> T parse_numeric();
     template<typename T> std::vector<T> parse_numeric_star();
     template<typename T> std::vector<T> parse_numeric_amount(std::uint64_t n);
@@ -57,6 +103,8 @@ private:
     std::vector<lean::name> parse_name_vec_amount(std::uint64_t n);
     
     /* Parsing of specific lines */
+    void push_level(lean::level const & l);
+    void push_expr(lean::expr const & e);
     void parse_name();
     void parse_level();
     void parse_expression();
@@ -72,10 +120,12 @@ private:
     /* Parsing the current line */
     void parse_line();
 
+
     /* Data members */
     
-    // Just the suffix of the line that is still to be parsed
-    sz::string_view line;
+    // The tokens of the line that are still to be parsed
+    const text_token * token;
+    const text_token * tokens_end;
     // The entire line that is currently being parsed, for printing out during debugging
     sz::string_view full_line;
     
@@ -83,6 +133,9 @@ private:
     bool error;
     // Are we in "prelude mode", where axioms are accepted?
     bool prelude;
+    unsigned jobs;
+    size_t chunk_size;
+    bool share_terms;
     
     std::vector<lean::expr> exprs;
     std::vector<lean::name> names;
@@ -91,4 +144,6 @@ private:
     std::vector<lean::declaration> decls;
     lean::name_hash_map<lean::constructor> constructors;
     lean::name_hash_map<lean::inductive_type> inductives;
+
+    ExprSharing sharing;
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "procstat.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+bool read_mem_stats(mem_stats & stats) {
+    FILE * f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) {
+        return false;
+    }
+    stats = mem_stats();
+    size_t shared_clean = 0, shared_dirty = 0, private_clean = 0, private_dirty = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "Rss: %zu kB", &stats.rss);
+        sscanf(line, "Pss: %zu kB", &stats.pss);
+        sscanf(line, "Shared_Clean: %zu kB", &shared_clean);
+        sscanf(line, "Shared_Dirty: %zu kB", &shared_dirty);
+        sscanf(line, "Private_Clean: %zu kB", &private_clean);
+        sscanf(line, "Private_Dirty: %zu kB", &private_dirty);
+    }
+    fclose(f);
+    stats.shared = shared_clean + shared_dirty;
+    stats.private_ = private_clean + private_dirty;
+    size_t current = 0;
+    if (!read_rss(current, stats.peak)) {
+        stats.peak = 0;
+    }
+    return true;
+}
+
+bool read_rss(size_t & current, size_t & peak) {
+    FILE * f = fopen("/proc/self/status", "r");
+    if (!f) {
+        return false;
+    }
+    bool have_current = false, have_peak = false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        have_current |= sscanf(line, "VmRSS: %zu kB", &current) == 1;
+        have_peak |= sscanf(line, "VmHWM: %zu kB", &peak) == 1;
+    }
+    fclose(f);
+    return have_current && have_peak;
+}
+
+bool reset_peak_rss() {
+    FILE * f = fopen("/proc/self/clear_refs", "w");
+    if (!f) {
+        return false;
+    }
+    bool ok = fputs("5", f) >= 0;
+    // The write happens here, and fails on kernels that do not know `5`
+    ok &= fclose(f) == 0;
+    return ok;
+}
+
+void report_mem_stats(char const * phase) {
+    static bool enabled = getenv("FUZZ_REPORT_MEMORY") != nullptr;
+    if (!enabled) {
+        return;
+    }
+    mem_stats stats;
+    if (!read_mem_stats(stats)) {
+        fprintf(stderr, "[mem] %d %s: smaps_rollup unavailable\n", getpid(), phase);
+        return;
+    }
+    fprintf(stderr, "[mem] %d %s: rss=%zukB peak=%zukB pss=%zukB shared=%zukB private=%zukB\n",
+            getpid(), phase, stats.rss, stats.peak, stats.pss, stats.shared, stats.private_);
+}
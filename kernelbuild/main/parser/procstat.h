@@ -0,0 +1,37 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <cstddef>
+
+/* Memory usage of the current process, as reported by `/proc/self/smaps_rollup`.
+
+   RSS counts every resident page, including the ones shared with other fuzzing instances,
+   while PSS divides shared pages by the number of processes mapping them. Summing PSS over all
+   instances gives the real footprint of a fuzzing campaign. `peak` is the highest RSS so far
+   (`VmHWM`), 0 if it is not available. All sizes are in kB. */
+struct mem_stats {
+    size_t rss = 0;
+    size_t peak = 0;
+    size_t pss = 0;
+    size_t shared = 0;
+    size_t private_ = 0;
+};
+
+// Returns false if `/proc/self/smaps_rollup` is not available.
+bool read_mem_stats(mem_stats & stats);
+
+// Prints the current memory usage to stderr, prefixed with `phase`, if the environment
+// variable `FUZZ_REPORT_MEMORY` is set. Does nothing otherwise.
+void report_mem_stats(char const * phase);
+
+// Reads the current and the peak RSS (`VmRSS` and `VmHWM` in `/proc/self/status`) in kB.
+// Returns false if they are not available.
+bool read_rss(size_t & current, size_t & peak);
+
+// Resets the peak RSS of the process to the current RSS, so that `read_rss` reports the peak
+// since this call. Returns false if the kernel does not support it (before Linux 4.0).
+bool reset_peak_rss();
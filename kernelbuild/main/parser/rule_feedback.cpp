@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "rule_feedback.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Provided by the AFL++ runtime, null when running without it
+extern "C" {
+__attribute__((weak)) extern unsigned char * __afl_area_ptr;
+__attribute__((weak)) extern unsigned int __afl_map_size;
+}
+
+static char const * bucket_name(unsigned bucket) {
+    switch (bucket) {
+        case 0: return "axiom";
+        case 1: return "definition";
+        case 2: return "theorem";
+        case 3: return "opaque";
+        case 4: return "quot";
+        case 5: return "mutual";
+        case 6: return "inductive";
+        default: return "other";
+    }
+}
+
+bool kernel_rules_enabled() {
+    return getenv("FUZZ_KERNEL_RULES") != nullptr;
+}
+
+void feed_kernel_rules_to_afl(unsigned char * map) {
+    if (&__afl_area_ptr != nullptr && __afl_area_ptr != nullptr) {
+        std::uint32_t map_size = &__afl_map_size != nullptr && __afl_map_size > 0 ? __afl_map_size : 65536;
+        for (std::uint32_t i = 0; i < lean::kernel_rule_map_size; ++i) {
+            if (map[i] != 0) {
+                // Fibonacci hashing spreads the entries over the whole map
+                std::uint32_t pos = (static_cast<std::uint64_t>((i + 1) * 2654435761u) * map_size) >> 32;
+                __afl_area_ptr[pos] += map[i];
+            }
+        }
+    }
+    memset(map, 0, lean::kernel_rule_map_size);
+}
+
+void print_kernel_rules(unsigned char const * map) {
+    for (unsigned bucket = 0; bucket < lean::num_kernel_rule_buckets; ++bucket) {
+        for (unsigned r = 0; r < lean::num_kernel_rules; ++r) {
+            unsigned count = map[bucket * lean::num_kernel_rules + r];
+            if (count != 0) {
+                std::cout << bucket_name(bucket) << " " << lean::kernel_rule_name(static_cast<lean::kernel_rule>(r))
+                          << ": " << count << (count == 255 ? "+" : "") << std::endl;
+            }
+        }
+    }
+}
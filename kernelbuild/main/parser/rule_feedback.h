@@ -0,0 +1,25 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include "kernel/rule_coverage.h"
+
+/* Kernel rule counters (see `kernel/rule_coverage.h`) as fuzzing feedback.
+
+   Under afl-fuzz, the counters are folded into the edge coverage map `__afl_area_ptr` after every
+   iteration, at fixed pseudo-random positions. A few hundred extra entries in a map with tens of
+   thousands of edges rarely collide with real edges, and AFL++ then treats "the unit-like rule
+   fired while checking an inductive" like any other new edge. libFuzzer picks the counters up
+   from its extra counters section instead, see `libfuzzer.cpp`. */
+
+// True if the environment variable `FUZZ_KERNEL_RULES` is set
+bool kernel_rules_enabled();
+
+// Adds the counters in `map` to the AFL++ coverage map, if there is one, and clears `map`
+void feed_kernel_rules_to_afl(unsigned char * map);
+
+// Prints the nonzero counters in `map`, one per line
+void print_kernel_rules(unsigned char const * map);
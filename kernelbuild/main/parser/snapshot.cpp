@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "snapshot.h"
+#include "runtime/compact.h"
+#include "runtime/hash.h"
+#include "runtime/sstream.h"
+#include "githash.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* On-disk format of a snapshot, modelled after `olean_header`. */
+struct snapshot_header {
+    // 6 bytes: magic number
+    char marker[6] = {'k', 'f', 's', 'n', 'a', 'p'};
+    // 1 byte: version, incremented on structural changes to the header
+    std::uint8_t version = 1;
+    // 1 byte of flags:
+    // * bit 0: whether persisted bignums use GMP or Lean-native encoding
+    // * bit 1-7: reserved
+    std::uint8_t flags =
+#ifdef LEAN_USE_GMP
+        0b1;
+#else
+        0b0;
+#endif
+    // 40 bytes: build githash, padded with `\0` to the right
+    char githash[40];
+    // hash of the `prelude.elean` the environment was checked from
+    std::uint64_t prelude_hash;
+    // address at which the beginning of the file (including header) is attempted to be mmapped
+    size_t base_addr;
+    // payload, the compacted `elab_environment`
+    size_t data[];
+};
+static_assert(sizeof(snapshot_header) == 6 + 1 + 1 + 40 + 8 + sizeof(size_t), "snapshot_header must be packed");
+
+std::uint64_t prelude_hash(std::string_view prelude) {
+    return lean::hash_str(prelude.size(), reinterpret_cast<unsigned char const *>(prelude.data()), 31);
+}
+
+// All instances map the snapshot at the same address so that the image can be mapped shared
+// without any relocation. The address is far below the region the kernel picks for `mmap` and
+// shared libraries (just below 0x7fff...), and far above the program break.
+#ifndef SNAPSHOT_BASE_ADDR
+#define SNAPSHOT_BASE_ADDR 0x500000000000
+#endif
+
+#ifndef MAP_FIXED_NOREPLACE
+// Older kernels treat the base address as a hint, which we check for below anyway
+#define MAP_FIXED_NOREPLACE 0
+#endif
+
+static bool g_snapshot_shared = false;
+
+void save_snapshot(std::string const & fname, lean::elab_environment const & env, std::uint64_t hash) {
+    size_t base_addr = SNAPSHOT_BASE_ADDR;
+    lean::object_compactor compactor(reinterpret_cast<void *>(base_addr));
+    compactor.alloc(sizeof(snapshot_header));
+    compactor(env.raw());
+
+    snapshot_header header = {};
+    strncpy(header.githash, LEAN_GITHASH, sizeof(header.githash));
+    header.prelude_hash = hash;
+    header.base_addr = base_addr;
+
+    // Write to a temporary file first so that running instances which still have the old
+    // snapshot mapped are not affected.
+    std::string tmp_fname = fname + ".tmp." + std::to_string(getpid());
+    std::ofstream out(tmp_fname, std::ios_base::binary);
+    out.write(reinterpret_cast<char *>(&header), sizeof(header));
+    out.write(static_cast<char const *>(compactor.data()) + sizeof(header), compactor.size() - sizeof(header));
+    out.close();
+    if (out.fail()) {
+        throw lean::exception((lean::sstream() << "failed to write snapshot '" << tmp_fname << "'").str());
+    }
+    if (std::rename(tmp_fname.c_str(), fname.c_str()) != 0) {
+        throw lean::exception((lean::sstream() << "failed to write snapshot '" << fname << "': " << strerror(errno)).str());
+    }
+}
+
+lean::optional<lean::elab_environment> load_snapshot(std::string const & fname, std::uint64_t hash) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cout << "Cannot open snapshot '" << fname << "': " << strerror(errno) << std::endl;
+        return lean::optional<lean::elab_environment>();
+    }
+
+    struct stat st;
+    snapshot_header default_header = {};
+    snapshot_header header;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(header)
+        || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.marker, default_header.marker, sizeof(header.marker)) != 0
+        || header.version != default_header.version || header.flags != default_header.flags
+        || strncmp(header.githash, LEAN_GITHASH, sizeof(header.githash)) != 0) {
+        std::cout << "Incompatible snapshot '" << fname << "'" << std::endl;
+        close(fd);
+        return lean::optional<lean::elab_environment>();
+    }
+    if (header.prelude_hash != hash) {
+        std::cout << "Snapshot '" << fname << "' is out of date with prelude.elean" << std::endl;
+        close(fd);
+        return lean::optional<lean::elab_environment>();
+    }
+
+    size_t size = st.st_size;
+    char * base_addr = reinterpret_cast<char *>(header.base_addr);
+    std::function<void()> free_data;
+    // Map the image read-only and shared: every instance and every forked child uses the same
+    // physical pages. The objects in the image are persistent, so nothing ever writes to them.
+    char * buffer = static_cast<char *>(mmap(base_addr, size, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0));
+    bool is_mmap = buffer == base_addr;
+    if (is_mmap) {
+        free_data = [=]() {
+            lean_always_assert(munmap(buffer, size) == 0);
+        };
+    } else {
+        if (buffer != MAP_FAILED) {
+            munmap(buffer, size);
+        }
+        // The base address is taken, so read the snapshot into memory and let `compacted_region` relocate it.
+        // This works, but the copy is private to this process.
+        std::cout << "Could not map snapshot '" << fname << "' at its base address, using a private copy" << std::endl;
+        buffer = static_cast<char *>(malloc(size));
+        std::ifstream in(fname, std::ios_base::binary);
+        if (!in.read(buffer, size)) {
+            std::cout << "Failed to read snapshot '" << fname << "'" << std::endl;
+            free(buffer);
+            close(fd);
+            return lean::optional<lean::elab_environment>();
+        }
+        free_data = [=]() {
+            free(buffer);
+        };
+    }
+    close(fd);
+    g_snapshot_shared = is_mmap;
+
+    // The region is never freed, the prelude environment lives as long as the process does.
+    lean::compacted_region * region =
+        new lean::compacted_region(size - sizeof(snapshot_header), buffer + sizeof(snapshot_header),
+                                   base_addr + sizeof(snapshot_header), is_mmap, free_data);
+    lean::object * env = region->read();
+    return lean::optional<lean::elab_environment>(lean::elab_environment(env));
+}
+
+bool snapshot_is_shared() {
+    return g_snapshot_shared;
+}
@@ -0,0 +1,33 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "runtime/optional.h"
+#include "library/elab_environment.h"
+
+/* Snapshots of the checked prelude environment.
+
+   A snapshot is the post-prelude `elab_environment`, serialized with `object_compactor` and
+   mapped back with `compacted_region`, the same way `.olean` files are handled in
+   `src/library/module.cpp`. Every snapshot records the hash of the prelude it was built from
+   and is rejected if the prelude has changed since.
+
+   Snapshots are mapped read-only and `MAP_SHARED` at a fixed base address, so parallel fuzzing
+   instances (and their forked children) share a single physical copy of the prelude. */
+
+std::uint64_t prelude_hash(std::string_view prelude);
+
+// Throws `lean::exception` if the snapshot cannot be written.
+void save_snapshot(std::string const & fname, lean::elab_environment const & env, std::uint64_t hash);
+
+// Returns `none` if the snapshot does not exist, is incompatible, or was built from a different prelude.
+lean::optional<lean::elab_environment> load_snapshot(std::string const & fname, std::uint64_t hash);
+
+// Returns true if the last snapshot loaded is mapped shared, rather than read into a private copy.
+bool snapshot_is_shared();
@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "startup_profile.h"
+#include "harness.h"
+
+#include <mimalloc.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct phase_record {
+    char const * name;
+    double wall_ms;
+    size_t cpu_ms;
+    long commit_kb;
+    long rss_kb;
+    size_t faults;
+    size_t live_blocks;
+    size_t live_kb;
+};
+
+struct decl_record {
+    double ms;
+    std::string name;
+    lean::declaration_kind kind;
+};
+
+static std::vector<phase_record> g_phases;
+static std::vector<decl_record> g_decls;
+
+struct process_info {
+    size_t cpu_msecs;
+    size_t commit;
+    size_t rss;
+    size_t faults;
+};
+
+static process_info get_process_info() {
+    size_t elapsed, user, sys, rss, peak_rss, commit, peak_commit, faults;
+    mi_process_info(&elapsed, &user, &sys, &rss, &peak_rss, &commit, &peak_commit, &faults);
+    return { user + sys, commit, rss, faults };
+}
+
+static bool count_block(const mi_heap_t *, const mi_heap_area_t * area, void * block, size_t, void * arg) {
+    if (block) {
+        size_t * counts = static_cast<size_t *>(arg);
+        counts[0]++;
+        counts[1] += area->block_size;
+    }
+    return true;
+}
+
+static lean::name decl_name(lean::declaration const & d) {
+    switch (d.kind()) {
+    case lean::declaration_kind::Axiom:            return d.to_axiom_val().get_name();
+    case lean::declaration_kind::Definition:       return d.to_definition_val().get_name();
+    case lean::declaration_kind::Theorem:          return d.to_theorem_val().get_name();
+    case lean::declaration_kind::Opaque:           return d.to_opaque_val().get_name();
+    case lean::declaration_kind::Quot:             return lean::name("Quot");
+    case lean::declaration_kind::MutualDefinition: return head(d.to_definition_vals()).get_name();
+    case lean::declaration_kind::Inductive:        return head(lean::inductive_decl(d).get_types()).get_name();
+    }
+    return lean::name();
+}
+
+bool startup_profile_enabled() {
+    static bool enabled = getenv("FUZZ_PROFILE_STARTUP") != nullptr;
+    return enabled;
+}
+
+StartupPhase::StartupPhase(char const * _name) :
+        name(_name) {
+    if (startup_profile_enabled()) {
+        process_info info = get_process_info();
+        start_cpu_msecs = info.cpu_msecs;
+        start_commit = info.commit;
+        start_rss = info.rss;
+        start_faults = info.faults;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+StartupPhase::~StartupPhase() {
+    if (!startup_profile_enabled()) {
+        return;
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    process_info info = get_process_info();
+    size_t live[2] = { 0, 0 };
+    mi_heap_visit_blocks(mi_heap_get_default(), true, count_block, live);
+    g_phases.push_back({ name, wall_ms, info.cpu_msecs - start_cpu_msecs,
+                         (static_cast<long>(info.commit) - static_cast<long>(start_commit)) / 1024,
+                         (static_cast<long>(info.rss) - static_cast<long>(start_rss)) / 1024,
+                         info.faults - start_faults, live[0], live[1] / 1024 });
+}
+
+void record_prelude_decl(lean::declaration const & d, double ms) {
+    g_decls.push_back({ ms, decl_name(d).to_string(), d.kind() });
+}
+
+void print_startup_profile() {
+    if (!startup_profile_enabled()) {
+        return;
+    }
+    double total_ms = 0;
+    for (phase_record const & p : g_phases) {
+        fprintf(stderr, "[startup] %-24s %10.2fms cpu=%zums commit=%+ldkB rss=%+ldkB faults=%zu live=%zu blocks/%zukB\n",
+                p.name, p.wall_ms, p.cpu_ms, p.commit_kb, p.rss_kb, p.faults, p.live_blocks, p.live_kb);
+        total_ms += p.wall_ms;
+    }
+    fprintf(stderr, "[startup] %-24s %10.2fms\n", "total", total_ms);
+
+    size_t top = 20;
+    if (char const * s = getenv("FUZZ_PROFILE_STARTUP")) {
+        if (size_t n = strtoul(s, nullptr, 10)) {
+            top = n;
+        }
+    }
+    std::vector<decl_record> decls = g_decls;
+    top = std::min(top, decls.size());
+    std::partial_sort(decls.begin(), decls.begin() + top, decls.end(),
+                      [](decl_record const & a, decl_record const & b) { return a.ms > b.ms; });
+    double decls_ms = 0;
+    for (decl_record const & d : g_decls) {
+        decls_ms += d.ms;
+    }
+    fprintf(stderr, "[startup] %zu prelude declarations in %.2fms, slowest:\n", g_decls.size(), decls_ms);
+    for (size_t i = 0; i < top; ++i) {
+        fprintf(stderr, "[startup] %10.3fms %5.1f%% %-10s %s\n", decls[i].ms,
+                decls_ms > 0 ? 100 * decls[i].ms / decls_ms : 0.0, declaration_kind_name(decls[i].kind), decls[i].name.c_str());
+    }
+}
@@ -0,0 +1,43 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include "kernel/declaration.h"
+
+/* Startup phase profiler.
+
+   Every forkserver (and every libFuzzer or batch run) pays for runtime initialization, reading
+   the string table and parsing and checking the prelude before the first testcase. If the
+   environment variable `FUZZ_PROFILE_STARTUP` is set, the setup code in `harness.cpp` records
+   for each of these phases the wall and CPU time, the growth of mimalloc's committed memory and
+   the resident set, page faults and the number of live heap blocks afterwards. Checking the
+   prelude additionally records the time spent on every declaration. `print_startup_profile`
+   prints all of it to stderr, together with the `FUZZ_PROFILE_STARTUP` slowest declarations
+   (20 if the variable is not a number). */
+
+bool startup_profile_enabled();
+
+// Records everything from construction to destruction as phase `name`, if profiling is enabled
+class StartupPhase {
+public:
+    StartupPhase(char const * name);
+    ~StartupPhase();
+
+private:
+    char const * name;
+    std::chrono::steady_clock::time_point start;
+    size_t start_cpu_msecs;
+    size_t start_commit;
+    size_t start_rss;
+    size_t start_faults;
+};
+
+// Records that adding `d` to the prelude environment took `ms` milliseconds
+void record_prelude_decl(lean::declaration const & d, double ms);
+
+void print_startup_profile();
@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "string_pool.h"
+#include "runtime/object.h"
+
+StringPool::StringPool(std::vector<std::string> _strings) :
+        strings(std::move(_strings)),
+        false_name("False"),
+        foo_name("foo") {
+    string_refs.reserve(strings.size());
+    names.reserve(strings.size());
+    for (const std::string & s : strings) {
+        string_refs.emplace_back(s);
+        names.emplace_back(lean::name::anonymous(), string_refs.back());
+        // Also marks the component, which is the object in `string_refs`
+        lean::mark_persistent(names.back().raw());
+    }
+    lean::mark_persistent(false_name.raw());
+    lean::mark_persistent(foo_name.raw());
+}
+
+size_t StringPool::size() const {
+    return strings.size();
+}
+
+const std::string & StringPool::get_string(size_t idx) const {
+    return strings[idx % strings.size()];
+}
+
+const lean::string_ref & StringPool::get_string_ref(size_t idx) const {
+    return string_refs[idx % string_refs.size()];
+}
+
+const lean::name & StringPool::get_name(size_t idx) const {
+    return names[idx % names.size()];
+}
+
+const lean::name & StringPool::get_false_name() const {
+    return false_name;
+}
+
+const lean::name & StringPool::get_foo_name() const {
+    return foo_name;
+}
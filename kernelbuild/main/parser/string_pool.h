@@ -0,0 +1,39 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "util/name.h"
+
+/* The `strings` table that testcases refer to by index, as ready-made Lean objects.
+
+   Built once at startup and marked persistent, so parsers can hand out its `string_ref`s and
+   single-component names without allocating or touching reference counts. Parsers borrow the
+   pool, so it must outlive them. */
+class StringPool {
+public:
+    explicit StringPool(std::vector<std::string> strings);
+
+    size_t size() const;
+
+    // Indices are reduced modulo the size of the table, like all indices in the binary format
+    const std::string & get_string(size_t idx) const;
+    const lean::string_ref & get_string_ref(size_t idx) const;
+    // The name consisting of the single component `get_string(idx)`
+    const lean::name & get_name(size_t idx) const;
+
+    // Names used by `BinParser::add_false`
+    const lean::name & get_false_name() const;
+    const lean::name & get_foo_name() const;
+
+private:
+    std::vector<std::string> strings;
+    std::vector<lean::string_ref> string_refs;
+    std::vector<lean::name> names;
+    lean::name false_name;
+    lean::name foo_name;
+};
@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "parser.h"
+#include "binwriter.h"
+#include "harness.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+/* Converts text exports (`markus-0.0.5`) to binary testcases, without going through Lean.
+
+   Every input is parsed with `Parser` and its declarations are written with `BinWriter`, to
+   `<output-dir>/<input stem>.belean` (default: the working directory). Axioms, opaque definitions
+   and `Quot` have no binary representation, and unsafe and partial declarations are left out like
+   the exporter does, so these are skipped. An input that does not parse, or
+   that does not fit into the binary format, is reported and produces no output. With `--v2`,
+   version 2 of the format is written (see `binformat.h`), which has no limits on table sizes.
+
+   Run from the directory with the `strings` table the testcases are for. Name components that
+   are not in the table yet are appended to it, and the table is written back at the end. */
+
+static bool convert(std::string const & input, std::filesystem::path const & output,
+                    std::vector<std::string> & strings, unsigned version) {
+    MappedFile file;
+    try {
+        file = MappedFile(input);
+    } catch (const std::filesystem::filesystem_error & ex) {
+        std::cout << input << ": " << ex.code().message() << std::endl;
+        return false;
+    }
+
+    Parser p(true);
+    p.handle_file(sz::string_view(file.text().data(), file.size()));
+    if (p.is_error()) {
+        std::cout << input << ": parse error" << std::endl;
+        return false;
+    }
+
+    // Keep the table unchanged if the input is rejected halfway
+    std::vector<std::string> new_strings = strings;
+    BinWriter w(new_strings, version);
+    size_t skipped = 0;
+    try {
+        for (const lean::declaration & d : p.get_decls()) {
+            if (!w.add_declaration(d)) {
+                ++skipped;
+            }
+        }
+    } catch (const lean::exception & ex) {
+        std::cout << input << ": " << ex.what() << std::endl;
+        return false;
+    }
+    strings = std::move(new_strings);
+
+    std::vector<std::uint8_t> data = w.get_data();
+    std::ofstream out(output, std::ios_base::binary);
+    out.write(reinterpret_cast<char const *>(data.data()), data.size());
+    std::cout << input << " -> " << output.string() << ": " << p.get_decls().size() - skipped
+              << " declarations, " << data.size() << " bytes";
+    if (skipped > 0) {
+        std::cout << ", skipped " << skipped << " the binary format leaves out";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+int main(int argc, char * argv[]) {
+    initialize_runtime();
+
+    std::filesystem::path output_dir = ".";
+    unsigned version = 1;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--output-dir" && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (arg == "--v2") {
+            version = 2;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    std::filesystem::create_directories(output_dir);
+
+    std::vector<std::string> strings = read_strings();
+    size_t old_strings = strings.size();
+    size_t failed = 0;
+    for (std::string const & input : inputs) {
+        std::filesystem::path output = output_dir / std::filesystem::path(input).stem();
+        output += ".belean";
+        if (!convert(input, output, strings, version)) {
+            ++failed;
+        }
+    }
+
+    if (strings.size() > old_strings) {
+        std::ofstream out("strings");
+        for (std::string const & s : strings) {
+            out << s << "\n";
+        }
+        std::cout << "Appended " << strings.size() - old_strings << " strings to strings" << std::endl;
+    }
+    std::cout << inputs.size() - failed << " of " << inputs.size() << " inputs converted" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
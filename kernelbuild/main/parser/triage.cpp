@@ -0,0 +1,365 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "triage.h"
+#include "batch.h"
+#include "binparser.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::vector<std::string> collect_crashes(std::vector<std::string> const & paths) {
+    std::vector<std::string> inputs;
+    for (std::string const & path : paths) {
+        if (!std::filesystem::is_directory(path)) {
+            std::vector<std::string> expanded = collect_inputs({ path });
+            inputs.insert(inputs.end(), expanded.begin(), expanded.end());
+            continue;
+        }
+        std::vector<std::string> files;
+        for (auto const & entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().filename() != "README.txt") {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        inputs.insert(inputs.end(), files.begin(), files.end());
+    }
+    return inputs;
+}
+
+/* The child. Everything it reports goes through a pipe, one line per item:
+   `outcome <signature>` if checking finished, or `frame <address>` for every frame if it crashed. */
+
+static constexpr int max_frames = 64;
+static int g_report_fd = -1;
+
+static void write_frame(void * addr) {
+    // Only async-signal-safe functions from here on
+    char line[32] = "frame ";
+    size_t len = 6;
+    std::uintptr_t value = reinterpret_cast<std::uintptr_t>(addr);
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        line[len++] = "0123456789abcdef"[(value >> shift) & 0xf];
+    }
+    line[len++] = '\n';
+    ssize_t written = write(g_report_fd, line, len);
+    (void)written;
+}
+
+static void crash_handler(int sig) {
+    void * frames[max_frames];
+    int n = backtrace(frames, max_frames);
+    for (int i = 0; i < n; ++i) {
+        write_frame(frames[i]);
+    }
+    // The handler was reset by `SA_RESETHAND`, so this terminates the child with `sig`
+    raise(sig);
+}
+
+static void install_crash_handlers() {
+    // Stack overflows are reported as `SIGSEGV` too
+    static char alt_stack[64 * 1024];
+    stack_t ss = {};
+    ss.ss_sp = alt_stack;
+    ss.ss_size = sizeof(alt_stack);
+    sigaltstack(&ss, nullptr);
+
+    struct sigaction sa = {};
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (int sig : { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL }) {
+        sigaction(sig, &sa, nullptr);
+    }
+}
+
+[[noreturn]] static void run_child(std::string const & input, int report_fd, StringPool const & strings,
+                                   lean::environment const & prelude_env, check_budget const & budget,
+                                   unsigned timeout) {
+    g_report_fd = report_fd;
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    dup2(devnull, STDERR_FILENO);
+    install_crash_handlers();
+    // Killed by `SIGALRM`, which is not handled
+    alarm(timeout);
+
+    std::string line;
+    try {
+        MappedFile data(input);
+        BinParser p(strings);
+        p.start(data.data(), data.size());
+        lean::environment env(prelude_env);
+        check_stats stats;
+        check_outcome outcome = check_testcase(env, p, budget, &stats);
+        line = "outcome " + outcome_signature(outcome, stats) + "\n";
+    } catch (const std::filesystem::filesystem_error &) {
+        line = "outcome unreadable\n";
+    }
+    ssize_t written = write(report_fd, line.data(), line.size());
+    _exit(written == static_cast<ssize_t>(line.size()) ? 0 : 1);
+}
+
+/* The parent */
+
+struct triage_result {
+    std::string input;
+    size_t size = 0;
+    std::string signature;
+    // Symbolized, libc frames at the top removed
+    std::vector<std::string> frames;
+};
+
+// Children are forked from this process, so their modules are mapped at the same addresses
+static std::string symbolize(void * addr, std::string & key) {
+    Dl_info info;
+    // Return addresses point after the call, look up the call itself
+    if (dladdr(static_cast<char *>(addr) - 1, &info) == 0 || info.dli_fname == nullptr) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%p", addr);
+        key = buf;
+        return key;
+    }
+    char offset[32];
+    snprintf(offset, sizeof(offset), "+0x%zx", static_cast<size_t>(static_cast<char *>(addr) - static_cast<char *>(info.dli_fbase)));
+    std::string location = std::filesystem::path(info.dli_fname).filename().string() + offset;
+    if (info.dli_sname == nullptr) {
+        key = location;
+        return location;
+    }
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    // Only the function goes into the hash, so that the bucket survives unrelated code changes
+    key = status == 0 && demangled ? demangled : info.dli_sname;
+    free(demangled);
+    return key + " (" + location + ")";
+}
+
+// True if `symbolize` names the functions of this binary, which needs `-rdynamic` (see `BUILD`).
+// Without it, signatures contain offsets, which change with every rebuild.
+static bool symbolizes_own_functions() {
+    std::string key;
+    // `symbolize` expects a return address
+    symbolize(reinterpret_cast<char *>(&run_triage) + 1, key);
+    return key.find("run_triage") != std::string::npos;
+}
+
+static bool in_libc(void * addr) {
+    static Dl_info libc = {};
+    static bool found = dladdr(reinterpret_cast<void *>(&abort), &libc) != 0;
+    Dl_info info;
+    return found && dladdr(addr, &info) != 0 && info.dli_fbase == libc.dli_fbase;
+}
+
+static std::uint64_t fnv1a(std::string const & s, std::uint64_t hash = 0xcbf29ce484222325ull) {
+    for (unsigned char c : s) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static triage_result collect_result(std::string const & input, std::string const & report, int status,
+                                    unsigned stack_depth) {
+    triage_result result;
+    result.input = input;
+    std::error_code ec;
+    result.size = std::filesystem::file_size(input, ec);
+
+    std::vector<void *> frames;
+    std::istringstream lines(report);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("outcome ", 0) == 0) {
+            result.signature = line.substr(8);
+        } else if (line.rfind("frame ", 0) == 0) {
+            frames.push_back(reinterpret_cast<void *>(std::stoull(line.substr(6), nullptr, 16)));
+        }
+    }
+
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        if (sig == SIGALRM) {
+            result.signature = "timeout";
+            return result;
+        }
+        result.signature = "signal " + std::to_string(sig) + " (" + strsignal(sig) + ")";
+        // The first frame is `crash_handler`
+        size_t first = std::min<size_t>(1, frames.size());
+        while (first < frames.size() && in_libc(frames[first])) {
+            ++first;
+        }
+        for (size_t i = first; i < frames.size() && result.frames.size() < stack_depth; ++i) {
+            std::string key;
+            result.frames.push_back(symbolize(frames[i], key));
+            result.signature += "\n" + key;
+        }
+    } else if (result.signature.empty()) {
+        result.signature = "exit " + std::to_string(WEXITSTATUS(status)) + " without outcome";
+    }
+    return result;
+}
+
+struct triage_child {
+    size_t input;
+    int report_fd;
+};
+
+static std::vector<triage_result> replay_all(std::vector<std::string> const & inputs, StringPool const & strings,
+                                             lean::environment const & prelude_env, check_budget const & budget,
+                                             triage_options const & options) {
+    // Load the unwinder now, instead of in the signal handler of every child
+    void * warmup[1];
+    backtrace(warmup, 1);
+    std::cout.flush();
+
+    std::vector<triage_result> results(inputs.size());
+    std::map<pid_t, triage_child> running;
+    unsigned jobs = std::max(1u, options.jobs);
+    size_t next = 0;
+    size_t done = 0;
+    while (next < inputs.size() || !running.empty()) {
+        while (next < inputs.size() && running.size() < jobs) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                break;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                run_child(inputs[next], fds[1], strings, prelude_env, budget, options.timeout);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                perror("fork");
+                close(fds[0]);
+                break;
+            }
+            running[pid] = { next++, fds[0] };
+        }
+        if (running.empty()) {
+            break;
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+        // A report fits into the pipe buffer, so the child never blocks on it
+        std::string report;
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(it->second.report_fd, buf, sizeof(buf))) > 0) {
+            report.append(buf, n);
+        }
+        close(it->second.report_fd);
+        size_t idx = it->second.input;
+        running.erase(it);
+        results[idx] = collect_result(inputs[idx], report, status, options.stack_depth);
+        if (++done % 100 == 0) {
+            std::cerr << "[triage] " << done << "/" << inputs.size() << std::endl;
+        }
+    }
+    return results;
+}
+
+struct triage_bucket {
+    std::string hash;
+    std::vector<triage_result const *> members;
+    // The smallest member
+    triage_result const * representative = nullptr;
+};
+
+static void write_bucket(triage_bucket const & bucket, std::filesystem::path const & dir) {
+    std::filesystem::create_directories(dir);
+    std::filesystem::path input(bucket.representative->input);
+    std::error_code ec;
+    std::filesystem::copy_file(input, dir / input.filename(), std::filesystem::copy_options::overwrite_existing, ec);
+
+    std::ofstream out(dir / "bucket.txt");
+    std::string const & signature = bucket.representative->signature;
+    out << "signature: " << signature.substr(0, signature.find('\n')) << "\n";
+    for (std::string const & frame : bucket.representative->frames) {
+        out << "  " << frame << "\n";
+    }
+    out << "representative: " << input.string() << " (" << bucket.representative->size << " bytes)\n";
+    out << "members: " << bucket.members.size() << "\n";
+    for (triage_result const * member : bucket.members) {
+        out << "  " << member->input << "\n";
+    }
+}
+
+int run_triage(std::vector<std::string> const & inputs, StringPool const & strings,
+               lean::environment const & prelude_env, check_budget const & budget,
+               triage_options const & options) {
+    std::error_code ec;
+    std::filesystem::create_directories(options.output_dir, ec);
+    if (ec) {
+        std::cout << "Cannot create " << options.output_dir << ": " << ec.message() << std::endl;
+        return setup_error_exit_code;
+    }
+
+    if (!symbolizes_own_functions()) {
+        std::cout << "Warning: frames of this binary cannot be named, link it with -rdynamic to get "
+                     "buckets that survive a rebuild" << std::endl;
+    }
+
+    std::vector<triage_result> results = replay_all(inputs, strings, prelude_env, budget, options);
+
+    std::map<std::string, triage_bucket> by_signature;
+    for (triage_result const & result : results) {
+        triage_bucket & bucket = by_signature[result.signature];
+        bucket.members.push_back(&result);
+        if (!bucket.representative || result.size < bucket.representative->size) {
+            bucket.representative = &result;
+        }
+    }
+    std::vector<triage_bucket> buckets;
+    for (auto & [signature, bucket] : by_signature) {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(fnv1a(signature)));
+        bucket.hash = hash;
+        buckets.push_back(std::move(bucket));
+    }
+    std::stable_sort(buckets.begin(), buckets.end(), [](triage_bucket const & a, triage_bucket const & b) {
+        return a.members.size() > b.members.size();
+    });
+
+    std::ostringstream summary;
+    summary << inputs.size() << " inputs, " << buckets.size() << " buckets\n";
+    for (triage_bucket const & bucket : buckets) {
+        write_bucket(bucket, std::filesystem::path(options.output_dir) / bucket.hash);
+        triage_result const & repr = *bucket.representative;
+        summary << bucket.hash << " " << bucket.members.size() << "x "
+                << repr.signature.substr(0, repr.signature.find('\n'));
+        if (!repr.frames.empty()) {
+            summary << " in " << repr.frames[0];
+        }
+        summary << "\n";
+    }
+    std::cout << summary.str();
+    std::ofstream(std::filesystem::path(options.output_dir) / "summary.txt") << summary.str();
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include "harness.h"
+#include "kernel/environment.h"
+
+/* Crash triage.
+
+   Replays a set of crashing inputs (usually the `crashes/` directories of an AFL output directory)
+   and groups them into buckets. Every input is checked in a forked child of the process that
+   loaded the prelude, so an abort or a segfault only takes down that child; up to `jobs` children
+   run at once.
+
+   The signature of an input is the `outcome_signature` of `check_testcase` if the child exits
+   normally, so kernel errors are grouped by exception type and a proof of `False` gets its own
+   bucket. If the child dies from a signal, the signature is the signal and the top `stack_depth`
+   frames of the stack at the time of the signal, with the frames in libc (`raise`, `abort`, ...)
+   skipped. Frames are symbolized with `dladdr`, so the binary must be linked with `-rdynamic` for
+   its own functions to have names (`run_triage` warns otherwise). Functions without a dynamic
+   symbol fall back to `module+offset`, which `addr2line -e module offset` resolves.
+
+   For every bucket, `output_dir/<hash>/` receives the smallest input of the bucket and a file
+   `bucket.txt` with the signature, the frames and all members. A summary, largest bucket first,
+   is written to stdout and `output_dir/summary.txt`. */
+
+struct triage_options {
+    unsigned jobs = 1;
+    // Frames that make up the stack signature of a crash
+    unsigned stack_depth = 5;
+    // Seconds before a child is killed, reported as `timeout`
+    unsigned timeout = 30;
+    std::string output_dir = "triage";
+};
+
+// Expands `paths` like `collect_inputs`, but descends into subdirectories and skips the
+// `README.txt` files AFL puts into its `crashes/` directories.
+std::vector<std::string> collect_crashes(std::vector<std::string> const & paths);
+
+// Returns `setup_error_exit_code` if `output_dir` cannot be created, and 0 otherwise.
+int run_triage(std::vector<std::string> const & inputs, StringPool const & strings,
+               lean::environment const & prelude_env, check_budget const & budget,
+               triage_options const & options);
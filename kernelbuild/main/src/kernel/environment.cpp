@@ -16,6 +16,7 @@ Author: Leonardo de Moura
 #include "kernel/kernel_exception.h"
 #include "kernel/type_checker.h"
 #include "kernel/quot.h"
+#include "kernel/rule_coverage.h"
 
 namespace lean {
 extern "C" object* lean_environment_add(object*, object*);
@@ -257,6 +258,7 @@ environment environment::add_mutual(declaration const & d, bool check) const {
 }
 
 environment environment::add(declaration const & d, bool check) const {
+    scope_kernel_rule_bucket bucket(d.kind());
     switch (d.kind()) {
     case declaration_kind::Axiom:            return add_axiom(d, check);
     case declaration_kind::Definition:       return add_definition(d, check);
@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "runtime/thread.h"
+#include "kernel/expr_flat_map.h"
+
+namespace lean {
+static_assert(sizeof(expr) == sizeof(object *), "unexpected expr size"); // NOLINT
+
+/* Smallest table, and the largest one kept in the pool. Larger tables only come from the few
+   declarations with huge caches and go straight back to `free`, so that the pool of a thread
+   stays below 2MB however large the caches of one declaration got. */
+constexpr unsigned min_log_capacity = 5;
+constexpr unsigned max_pooled_log_capacity = 12;
+/* Tables of each size kept in the pool. A type checker state has four caches, and the
+   checkers of `add_inductive` are alive at the same time. */
+constexpr unsigned max_pooled_per_size = 8;
+
+/* Empty tables by log2 of their capacity. The memory comes from `malloc`, never from a heap
+   of the iteration (see `parser/iteration_heap.h`), since it outlives the state. */
+struct expr_flat_map_pool {
+    std::vector<void *> m_free[max_pooled_log_capacity + 1];
+    ~expr_flat_map_pool() {
+        for (auto & free : m_free)
+            for (void * p : free)
+                std::free(p);
+    }
+};
+
+static expr_flat_map_pool & get_pool() {
+    static LEAN_THREAD_LOCAL expr_flat_map_pool pool;
+    return pool;
+}
+
+static void * alloc_table(unsigned log_capacity, size_t bytes) {
+    if (log_capacity <= max_pooled_log_capacity) {
+        std::vector<void *> & free = get_pool().m_free[log_capacity];
+        if (!free.empty()) {
+            void * p = free.back();
+            free.pop_back();
+            return p;
+        }
+    }
+    void * p = std::calloc(1, bytes);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+/* \c p must be all zeros */
+static void free_table(void * p, unsigned log_capacity) {
+    if (log_capacity <= max_pooled_log_capacity) {
+        std::vector<void *> & free = get_pool().m_free[log_capacity];
+        if (free.size() < max_pooled_per_size) {
+            free.push_back(p);
+            return;
+        }
+    }
+    std::free(p);
+}
+
+unsigned expr_flat_map::index_of(unsigned h) const {
+    /* Fibonacci hashing, the index is taken from the high bits of the product, which depend on all
+       bits of the hash */
+    return (h * 2654435769u) >> m_shift;
+}
+
+expr const * expr_flat_map::find(expr const & e) const {
+    if (m_size == 0)
+        return nullptr;
+    unsigned h    = hash(e);
+    unsigned mask = m_capacity - 1;
+    for (unsigned i = index_of(h);; i = (i + 1) & mask) {
+        entry const & en = m_entries[i];
+        if (en.m_key == nullptr)
+            return nullptr;
+        if (en.m_hash == h &&
+            (en.m_key == e.raw() || reinterpret_cast<expr const &>(en.m_key) == e))
+            return reinterpret_cast<expr const *>(&en.m_value);
+    }
+}
+
+void expr_flat_map::insert(expr const & e, expr const & v) {
+    /* At most half full */
+    if (2 * (m_size + 1) > m_capacity)
+        grow();
+    unsigned h    = hash(e);
+    unsigned mask = m_capacity - 1;
+    for (unsigned i = index_of(h);; i = (i + 1) & mask) {
+        entry & en = m_entries[i];
+        if (en.m_key == nullptr) {
+            inc(e.raw());
+            inc(v.raw());
+            en.m_hash  = h;
+            en.m_key   = e.raw();
+            en.m_value = v.raw();
+            m_size++;
+            return;
+        }
+        if (en.m_hash == h &&
+            (en.m_key == e.raw() || reinterpret_cast<expr const &>(en.m_key) == e))
+            return;
+    }
+}
+
+void expr_flat_map::grow() {
+    unsigned old_log_capacity = 32 - m_shift;
+    unsigned log_capacity     = m_capacity == 0 ? min_log_capacity : old_log_capacity + 1;
+    entry * old_entries       = m_entries;
+    unsigned old_capacity     = m_capacity;
+    m_entries  = static_cast<entry *>(alloc_table(log_capacity, sizeof(entry) << log_capacity));
+    m_capacity = 1u << log_capacity;
+    m_shift    = 32 - log_capacity;
+    /* The stored hashes save recomputing them, and the references move along */
+    unsigned mask = m_capacity - 1;
+    for (unsigned j = 0; j < old_capacity; j++) {
+        entry const & en = old_entries[j];
+        if (en.m_key == nullptr)
+            continue;
+        unsigned i = index_of(en.m_hash);
+        while (m_entries[i].m_key != nullptr)
+            i = (i + 1) & mask;
+        m_entries[i] = en;
+    }
+    if (old_entries) {
+        std::memset(old_entries, 0, sizeof(entry) * old_capacity);
+        free_table(old_entries, old_log_capacity);
+    }
+}
+
+void expr_flat_map::clear() {
+    if (m_size == 0)
+        return;
+    for (unsigned i = 0; i < m_capacity; i++) {
+        entry & en = m_entries[i];
+        if (en.m_key != nullptr) {
+            dec(en.m_key);
+            dec(en.m_value);
+        }
+    }
+    std::memset(m_entries, 0, sizeof(entry) * m_capacity);
+    m_size = 0;
+}
+
+void expr_flat_map::release() {
+    if (m_entries == nullptr)
+        return;
+    clear();
+    free_table(m_entries, 32 - m_shift);
+    m_entries  = nullptr;
+    m_capacity = 0;
+    m_shift    = 0;
+}
+}
@@ -0,0 +1,51 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include "kernel/expr.h"
+
+namespace lean {
+/** \brief Map from expressions to expressions, for the caches of the type checker.
+
+    Keys are compared with \c == (structural equality, binder information is ignored), like
+    in \c expr_map. The table uses open addressing with linear probing, and every entry holds
+    the hash of its key next to the key and value pointers, so a probe only touches an object
+    when the hashes match, and then compares pointers before comparing structurally.
+
+    Like \c std::unordered_map::insert, \c insert does not replace an existing entry.
+
+    Tables come from a small pool of buffers of the current thread. The type checker creates new
+    caches for every declaration, which then reuse the buffers of earlier ones instead of
+    allocating one node per entry. Only used with \c LEAN_FLAT_TYPE_CHECKER_CACHES. */
+class expr_flat_map {
+    struct entry {
+        unsigned m_hash;
+        /* nullptr if the entry is empty */
+        object * m_key;
+        object * m_value;
+    };
+    entry *  m_entries;
+    /* Zero or a power of two */
+    unsigned m_capacity;
+    unsigned m_shift;
+    unsigned m_size;
+
+    unsigned index_of(unsigned h) const;
+    void grow();
+    void release();
+public:
+    expr_flat_map():m_entries(nullptr), m_capacity(0), m_shift(0), m_size(0) {}
+    expr_flat_map(expr_flat_map const &) = delete;
+    expr_flat_map & operator=(expr_flat_map const &) = delete;
+    ~expr_flat_map() { release(); }
+
+    /** \brief Return the value of \c e, or nullptr. It is valid until the next \c insert. */
+    expr const * find(expr const & e) const;
+    void insert(expr const & e, expr const & v);
+    unsigned size() const { return m_size; }
+    void clear();
+};
+}
@@ -7,6 +7,7 @@ Author: Leonardo de Moura
 #pragma once
 #include "kernel/environment.h"
 #include "kernel/instantiate.h"
+#include "kernel/rule_coverage.h"
 namespace lean {
 /** \brief Return recursor name for the given inductive datatype name */
 name mk_rec_name(name const & I);
@@ -86,15 +87,24 @@ inline optional<expr> inductive_reduce_rec(environment const & env, expr const &
     if (major_idx >= rec_args.size()) return none_expr(); // major premise is missing
     expr major     = rec_args[major_idx];
     if (rec_val.is_k()) {
-        major = to_cnstr_when_K(env, rec_val, major, whnf, infer_type, is_def_eq);
+        expr new_major = to_cnstr_when_K(env, rec_val, major, whnf, infer_type, is_def_eq);
+        if (!is_eqp(new_major, major))
+            record_kernel_rule(kernel_rule::RecK);
+        major = new_major;
     }
     major = whnf(major);
-    if (is_nat_lit(major))
+    if (is_nat_lit(major)) {
+        record_kernel_rule(kernel_rule::RecNatLit);
         major = nat_lit_to_constructor(major);
-    else if (is_string_lit(major))
+    } else if (is_string_lit(major)) {
+        record_kernel_rule(kernel_rule::RecStringLit);
         major = string_lit_to_constructor(major);
-    else
-        major = to_cnstr_when_structure(env, rec_val.get_major_induct(), major, whnf, infer_type);
+    } else {
+        expr new_major = to_cnstr_when_structure(env, rec_val.get_major_induct(), major, whnf, infer_type);
+        if (!is_eqp(new_major, major))
+            record_kernel_rule(kernel_rule::RecEtaStruct);
+        major = new_major;
+    }
     optional<recursor_rule> rule = get_rec_rule_for(rec_val, major);
     if (!rule) return none_expr();
     buffer<expr> major_args;
@@ -115,6 +125,7 @@ inline optional<expr> inductive_reduce_rec(environment const & env, expr const &
         unsigned nextra = rec_args.size() - major_idx - 1;
         rhs = mk_app(rhs, nextra, rec_args.data() + major_idx + 1);
     }
+    record_kernel_rule(kernel_rule::RecIota);
     return some_expr(rhs);
 }
 
@@ -8,6 +8,7 @@ Quotient types.
 */
 #pragma once
 #include "kernel/environment.h"
+#include "kernel/rule_coverage.h"
 
 namespace lean {
 class quot_consts {
@@ -66,6 +67,7 @@ template<typename WHNF> optional<expr> quot_reduce_rec(expr const & e, WHNF cons
     unsigned elim_arity = mk_pos+1;
     if (args.size() > elim_arity)
         r = mk_app(r, args.size() - elim_arity, args.begin() + elim_arity);
+    record_kernel_rule(const_name(fn) == *quot_consts::g_quot_lift ? kernel_rule::QuotLift : kernel_rule::QuotInd);
     return some_expr(r);
 }
 
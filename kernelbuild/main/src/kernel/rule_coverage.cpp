@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#include "kernel/rule_coverage.h"
+
+namespace lean {
+LEAN_THREAD_GLOBAL_PTR(unsigned char, g_kernel_rule_counters);
+LEAN_THREAD_PTR(unsigned char, g_kernel_rule_map);
+LEAN_THREAD_VALUE(unsigned, g_kernel_rule_bucket, num_kernel_rule_buckets - 1);
+
+static void update_counters() {
+    g_kernel_rule_counters = g_kernel_rule_map ? g_kernel_rule_map + g_kernel_rule_bucket * num_kernel_rules : nullptr;
+}
+
+static_assert(static_cast<unsigned>(declaration_kind::Inductive) < num_kernel_rule_buckets - 1,
+              "every declaration kind needs its own bucket");
+
+char const * kernel_rule_name(kernel_rule r) {
+    switch (r) {
+    case kernel_rule::WhnfBeta:        return "whnf.beta";
+    case kernel_rule::WhnfZetaFVar:    return "whnf.zeta_fvar";
+    case kernel_rule::WhnfZetaLet:     return "whnf.zeta_let";
+    case kernel_rule::WhnfProj:        return "whnf.proj";
+    case kernel_rule::WhnfRecursor:    return "whnf.recursor";
+    case kernel_rule::RecK:            return "rec.k";
+    case kernel_rule::RecNatLit:       return "rec.nat_lit";
+    case kernel_rule::RecStringLit:    return "rec.string_lit";
+    case kernel_rule::RecEtaStruct:    return "rec.eta_struct";
+    case kernel_rule::RecIota:         return "rec.iota";
+    case kernel_rule::QuotLift:        return "quot.lift";
+    case kernel_rule::QuotInd:         return "quot.ind";
+    case kernel_rule::DeltaLeft:       return "delta.left";
+    case kernel_rule::DeltaRight:      return "delta.right";
+    case kernel_rule::DeltaProjLeft:   return "delta.proj_left";
+    case kernel_rule::DeltaProjRight:  return "delta.proj_right";
+    case kernel_rule::DeltaBoth:       return "delta.both";
+    case kernel_rule::DeltaSameArgs:   return "delta.same_args";
+    case kernel_rule::DefEqQuick:      return "def_eq.quick";
+    case kernel_rule::DefEqBoolTrue:   return "def_eq.bool_true";
+    case kernel_rule::DefEqProofIrrel: return "def_eq.proof_irrel";
+    case kernel_rule::DefEqLazyDelta:  return "def_eq.lazy_delta";
+    case kernel_rule::DefEqConst:      return "def_eq.const";
+    case kernel_rule::DefEqFVar:       return "def_eq.fvar";
+    case kernel_rule::DefEqProj:       return "def_eq.proj";
+    case kernel_rule::DefEqWhnfCore:   return "def_eq.whnf_core";
+    case kernel_rule::DefEqApp:        return "def_eq.app";
+    case kernel_rule::DefEqEta:        return "def_eq.eta";
+    case kernel_rule::DefEqEtaStruct:  return "def_eq.eta_struct";
+    case kernel_rule::DefEqStringLit:  return "def_eq.string_lit";
+    case kernel_rule::DefEqUnitLike:   return "def_eq.unit_like";
+    case kernel_rule::DefEqFail:       return "def_eq.fail";
+    case kernel_rule::NumRules:        break;
+    }
+    return "unknown";
+}
+
+scope_kernel_rule_map::scope_kernel_rule_map(unsigned char * map):
+    m_old_map(g_kernel_rule_map) {
+    g_kernel_rule_map = map;
+    update_counters();
+}
+
+scope_kernel_rule_map::~scope_kernel_rule_map() {
+    g_kernel_rule_map = m_old_map;
+    update_counters();
+}
+
+scope_kernel_rule_bucket::scope_kernel_rule_bucket(declaration_kind k):
+    m_old_bucket(g_kernel_rule_bucket) {
+    g_kernel_rule_bucket = static_cast<unsigned>(k);
+    update_counters();
+}
+
+scope_kernel_rule_bucket::~scope_kernel_rule_bucket() {
+    g_kernel_rule_bucket = m_old_bucket;
+    update_counters();
+}
+}
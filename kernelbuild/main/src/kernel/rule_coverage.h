@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2025 Markus Himmel. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Markus Himmel
+*/
+#pragma once
+#include "runtime/thread.h"
+#include "kernel/declaration.h"
+
+namespace lean {
+/** \brief Reduction and definitional equality rules applied by the type checker.
+
+    Edge coverage does not distinguish, say, eta for structures from unit-like definitional
+    equality once both code paths have been seen. When a rule map is installed, every rule that
+    fires increments a counter for the kind of the declaration being checked, which a fuzzer can
+    use as additional feedback. */
+enum class kernel_rule : unsigned {
+    /* whnf_core */
+    WhnfBeta, WhnfZetaFVar, WhnfZetaLet, WhnfProj, WhnfRecursor,
+    /* inductive_reduce_rec */
+    RecK, RecNatLit, RecStringLit, RecEtaStruct, RecIota,
+    /* quot_reduce_rec */
+    QuotLift, QuotInd,
+    /* lazy_delta_reduction_step */
+    DeltaLeft, DeltaRight, DeltaProjLeft, DeltaProjRight, DeltaBoth, DeltaSameArgs,
+    /* is_def_eq_core */
+    DefEqQuick, DefEqBoolTrue, DefEqProofIrrel, DefEqLazyDelta, DefEqConst, DefEqFVar, DefEqProj,
+    DefEqWhnfCore, DefEqApp, DefEqEta, DefEqEtaStruct, DefEqStringLit, DefEqUnitLike, DefEqFail,
+    NumRules
+};
+
+constexpr unsigned num_kernel_rules = static_cast<unsigned>(kernel_rule::NumRules);
+/* One bucket per `declaration_kind`, and one for checks outside of `environment::add` */
+constexpr unsigned num_kernel_rule_buckets = 8;
+constexpr unsigned kernel_rule_map_size = num_kernel_rules * num_kernel_rule_buckets;
+
+/* The counters of the current bucket in the rule map of this thread, if one is installed */
+LEAN_THREAD_EXTERN_PTR(unsigned char, g_kernel_rule_counters);
+
+/** \brief Increment the (saturating) counter of \c r, if a rule map is installed. */
+inline void record_kernel_rule(kernel_rule r) {
+    if (g_kernel_rule_counters) {
+        unsigned char & c = g_kernel_rule_counters[static_cast<unsigned>(r)];
+        if (c != 255)
+            c++;
+    }
+}
+
+char const * kernel_rule_name(kernel_rule r);
+
+/** \brief Install \c map (of size \c kernel_rule_map_size) for this thread in this scope. */
+class scope_kernel_rule_map {
+    unsigned char * m_old_map;
+public:
+    scope_kernel_rule_map(unsigned char * map);
+    ~scope_kernel_rule_map();
+};
+
+/** \brief Count rules for declarations of kind \c k in this scope. */
+class scope_kernel_rule_bucket {
+    unsigned m_old_bucket;
+public:
+    scope_kernel_rule_bucket(declaration_kind k);
+    ~scope_kernel_rule_bucket();
+};
+}
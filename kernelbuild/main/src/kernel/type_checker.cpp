@@ -20,6 +20,7 @@ Author: Leonardo de Moura
 #include "kernel/for_each_fn.h"
 #include "kernel/quot.h"
 #include "kernel/inductive.h"
+#include "kernel/rule_coverage.h"
 
 namespace lean {
 static name * g_kernel_fresh = nullptr;
@@ -45,6 +46,25 @@ static expr * g_nat_shiftRight = nullptr;
 type_checker::state::state(environment const & env):
     m_env(env), m_ngen(*g_kernel_fresh) {}
 
+#ifdef LEAN_FLAT_TYPE_CHECKER_CACHES
+static expr const * cache_find(expr_flat_map const & cache, expr const & e) {
+    return cache.find(e);
+}
+
+static void cache_insert(expr_flat_map & cache, expr const & e, expr const & v) {
+    cache.insert(e, v);
+}
+#else
+static expr const * cache_find(expr_map<expr> const & cache, expr const & e) {
+    auto it = cache.find(e);
+    return it != cache.end() ? &it->second : nullptr;
+}
+
+static void cache_insert(expr_map<expr> & cache, expr const & e, expr const & v) {
+    cache.insert(mk_pair(e, v));
+}
+#endif
+
 /** \brief Make sure \c e "is" a sort, and return the corresponding sort.
     If \c e is not a sort, then the whnf procedure is invoked.
 
@@ -297,9 +317,8 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     }
     check_system("type checker", /* do_check_interrupted */ true);
 
-    auto it = m_st->m_infer_type[infer_only].find(e);
-    if (it != m_st->m_infer_type[infer_only].end())
-        return it->second;
+    if (expr const * c = cache_find(m_st->m_infer_type[infer_only], e))
+        return *c;
 
     expr r;
     switch (e.kind()) {
@@ -321,7 +340,7 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     case expr_kind::Let:      r = infer_let(e, infer_only);            break;
     }
 
-    m_st->m_infer_type[infer_only].insert(mk_pair(e, r));
+    cache_insert(m_st->m_infer_type[infer_only], e, r);
     return r;
 }
 
@@ -373,6 +392,7 @@ expr type_checker::whnf_fvar(expr const & e, bool cheap_rec, bool cheap_proj) {
     if (optional<local_decl> decl = m_lctx.find_local_decl(e)) {
         if (optional<expr> const & v = decl->get_value()) {
             /* zeta-reduction */
+            record_kernel_rule(kernel_rule::WhnfZetaFVar);
             return whnf_core(*v, cheap_rec, cheap_proj);
         }
     }
@@ -444,9 +464,8 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
     }
 
     // check cache
-    auto it = m_st->m_whnf_core.find(e);
-    if (it != m_st->m_whnf_core.end())
-        return it->second;
+    if (expr const * c = cache_find(m_st->m_whnf_core, e))
+        return *c;
 
     // do the actual work
     expr r;
@@ -458,9 +477,10 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
     case expr_kind::FVar:
         return whnf_fvar(e, cheap_rec, cheap_proj);
     case expr_kind::Proj: {
-        if (auto m = reduce_proj(e, cheap_rec, cheap_proj))
+        if (auto m = reduce_proj(e, cheap_rec, cheap_proj)) {
+            record_kernel_rule(kernel_rule::WhnfProj);
             r = whnf_core(*m, cheap_rec, cheap_proj);
-        else
+        } else
             r = e;
         break;
     }
@@ -476,6 +496,7 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
                 m++;
             }
             lean_assert(m <= num_args);
+            record_kernel_rule(kernel_rule::WhnfBeta);
             r = whnf_core(mk_rev_app(instantiate(binding_body(f), m, args.data() + (num_args - m)), num_args - m, args.data()),
                           cheap_rec, cheap_proj);
         } else if (f == f0) {
@@ -486,6 +507,7 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
                         m_diag->record_unfold(const_name(f));
                 }
                 /* iota-reduction and quotient reduction rules */
+                record_kernel_rule(kernel_rule::WhnfRecursor);
                 return whnf_core(*r, cheap_rec, cheap_proj);
             } else {
                 return e;
@@ -496,12 +518,13 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
         break;
     }
     case expr_kind::Let:
+        record_kernel_rule(kernel_rule::WhnfZetaLet);
         r = whnf_core(instantiate(let_body(e), let_value(e)), cheap_rec, cheap_proj);
         break;
     }
 
     if (!cheap_rec && !cheap_proj) {
-        m_st->m_whnf_core.insert(mk_pair(e, r));
+        cache_insert(m_st->m_whnf_core, e, r);
     }
     return r;
 }
@@ -674,24 +697,23 @@ expr type_checker::whnf(expr const & e) {
     }
 
     // check cache
-    auto it = m_st->m_whnf.find(e);
-    if (it != m_st->m_whnf.end())
-        return it->second;
+    if (expr const * c = cache_find(m_st->m_whnf, e))
+        return *c;
 
     expr t = e;
     while (true) {
         expr t1 = whnf_core(t);
         if (auto v = reduce_native(env(), t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
+            cache_insert(m_st->m_whnf, e, *v);
             return *v;
         } else if (auto v = reduce_nat(t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
+            cache_insert(m_st->m_whnf, e, *v);
             return *v;
         } else if (auto next_t = unfold_definition(t1)) {
             t = *next_t;
         } else {
             auto r = t1;
-            m_st->m_whnf.insert(mk_pair(e, r));
+            cache_insert(m_st->m_whnf, e, r);
             return r;
         }
     }
@@ -913,22 +935,28 @@ auto type_checker::lazy_delta_reduction_step(expr & t_n, expr & s_n) -> reductio
            defined using well-founded recursion).
         */
         if (auto s_n_new = try_unfold_proj_app(s_n)) {
+            record_kernel_rule(kernel_rule::DeltaProjRight);
             s_n = *s_n_new;
         } else {
+            record_kernel_rule(kernel_rule::DeltaLeft);
             t_n = whnf_core(*unfold_definition(t_n), false, true);
         }
     } else if (!d_t && d_s) {
         /* If `t_n` is a projection application, we try to unfold it instead. See comment above. */
         if (auto t_n_new = try_unfold_proj_app(t_n)) {
+            record_kernel_rule(kernel_rule::DeltaProjLeft);
             t_n = *t_n_new;
         } else {
+            record_kernel_rule(kernel_rule::DeltaRight);
             s_n = whnf_core(*unfold_definition(s_n), false, true);
         }
     } else {
         int c = compare(d_t->get_hints(), d_s->get_hints());
         if (c < 0) {
+            record_kernel_rule(kernel_rule::DeltaLeft);
             t_n = whnf_core(*unfold_definition(t_n), false, true);
         } else if (c > 0) {
+            record_kernel_rule(kernel_rule::DeltaRight);
             s_n = whnf_core(*unfold_definition(s_n), false, true);
         } else {
             if (is_app(t_n) && is_app(s_n) && is_eqp(*d_t, *d_s) && d_t->get_hints().is_regular()) {
@@ -939,12 +967,14 @@ auto type_checker::lazy_delta_reduction_step(expr & t_n, expr & s_n) -> reductio
                 if (!failed_before(t_n, s_n)) {
                     if (is_def_eq(const_levels(get_app_fn(t_n)), const_levels(get_app_fn(s_n))) &&
                         is_def_eq_args(t_n, s_n)) {
+                        record_kernel_rule(kernel_rule::DeltaSameArgs);
                         return reduction_status::DefEqual;
                     } else {
                         cache_failure(t_n, s_n);
                     }
                 }
             }
+            record_kernel_rule(kernel_rule::DeltaBoth);
             t_n = whnf_core(*unfold_definition(t_n), false, true);
             s_n = whnf_core(*unfold_definition(s_n), false, true);
         }
@@ -1074,7 +1104,10 @@ bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
     check_system("is_definitionally_equal", /* do_check_interrupted */ true);
     bool use_hash = true;
     lbool r = quick_is_def_eq(t, s, use_hash);
-    if (r != l_undef) return r == l_true;
+    if (r != l_undef) {
+        record_kernel_rule(kernel_rule::DefEqQuick);
+        return r == l_true;
+    }
 
     // Very basic support for proofs by reflection. If `t` has no free variables and `s` is `Bool.true`,
     // we fully reduce `t` and check whether result is `s`.
@@ -1082,6 +1115,7 @@ bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
     // proof terms of the form `Eq.refl true : decide p = true`.
     if (!has_fvar(t) && is_constant(s, *g_bool_true)) {
         if (is_constant(whnf(t), *g_bool_true)) {
+            record_kernel_rule(kernel_rule::DefEqBoolTrue);
             return true;
         }
     }
@@ -1098,52 +1132,81 @@ bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
 
     if (!is_eqp(t_n, t) || !is_eqp(s_n, s)) {
         r = quick_is_def_eq(t_n, s_n);
-        if (r != l_undef) return r == l_true;
+        if (r != l_undef) {
+            record_kernel_rule(kernel_rule::DefEqQuick);
+            return r == l_true;
+        }
     }
 
     r = is_def_eq_proof_irrel(t_n, s_n);
-    if (r != l_undef) return r == l_true;
+    if (r != l_undef) {
+        record_kernel_rule(kernel_rule::DefEqProofIrrel);
+        return r == l_true;
+    }
 
     /* NB: `lazy_delta_reduction` updates `t_n` and `s_n` even when returning `l_undef`. */
     r = lazy_delta_reduction(t_n, s_n);
-    if (r != l_undef) return r == l_true;
+    if (r != l_undef) {
+        record_kernel_rule(kernel_rule::DefEqLazyDelta);
+        return r == l_true;
+    }
 
     if (is_constant(t_n) && is_constant(s_n) && const_name(t_n) == const_name(s_n) &&
-        is_def_eq(const_levels(t_n), const_levels(s_n)))
+        is_def_eq(const_levels(t_n), const_levels(s_n))) {
+        record_kernel_rule(kernel_rule::DefEqConst);
         return true;
+    }
 
-    if (is_fvar(t_n) && is_fvar(s_n) && fvar_name(t_n) == fvar_name(s_n))
+    if (is_fvar(t_n) && is_fvar(s_n) && fvar_name(t_n) == fvar_name(s_n)) {
+        record_kernel_rule(kernel_rule::DefEqFVar);
         return true;
+    }
 
     if (is_proj(t_n) && is_proj(s_n) && proj_idx(t_n) == proj_idx(s_n)) {
         expr t_c = proj_expr(t_n);
         expr s_c = proj_expr(s_n);
-        if (lazy_delta_proj_reduction(t_c, s_c, proj_idx(t_n)))
+        if (lazy_delta_proj_reduction(t_c, s_c, proj_idx(t_n))) {
+            record_kernel_rule(kernel_rule::DefEqProj);
             return true;
+        }
     }
 
     // Invoke `whnf_core` again, but now using `whnf` to reduce projections.
     expr t_n_n = whnf_core(t_n);
     expr s_n_n = whnf_core(s_n);
-    if (!is_eqp(t_n_n, t_n) || !is_eqp(s_n_n, s_n))
+    if (!is_eqp(t_n_n, t_n) || !is_eqp(s_n_n, s_n)) {
+        record_kernel_rule(kernel_rule::DefEqWhnfCore);
         return is_def_eq_core(t_n_n, s_n_n);
+    }
 
     // At this point, t_n and s_n are in weak head normal form (modulo metavariables and proof irrelevance)
-    if (is_def_eq_app(t_n, s_n))
+    if (is_def_eq_app(t_n, s_n)) {
+        record_kernel_rule(kernel_rule::DefEqApp);
         return true;
+    }
 
-    if (try_eta_expansion(t_n, s_n))
+    if (try_eta_expansion(t_n, s_n)) {
+        record_kernel_rule(kernel_rule::DefEqEta);
         return true;
+    }
 
-    if (try_eta_struct(t_n, s_n))
+    if (try_eta_struct(t_n, s_n)) {
+        record_kernel_rule(kernel_rule::DefEqEtaStruct);
         return true;
+    }
 
     r = try_string_lit_expansion(t_n, s_n);
-    if (r != l_undef) return r == l_true;
+    if (r != l_undef) {
+        record_kernel_rule(kernel_rule::DefEqStringLit);
+        return r == l_true;
+    }
 
-    if (is_def_eq_unit_like(t_n, s_n))
+    if (is_def_eq_unit_like(t_n, s_n)) {
+        record_kernel_rule(kernel_rule::DefEqUnitLike);
         return true;
+    }
 
+    record_kernel_rule(kernel_rule::DefEqFail);
     return false;
 }
 
@@ -16,6 +16,7 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "kernel/local_ctx.h"
 #include "kernel/expr_maps.h"
+#include "kernel/expr_flat_map.h"
 #include "kernel/equiv_manager.h"
 
 namespace lean {
@@ -24,13 +25,18 @@ namespace lean {
 class type_checker {
 public:
     class state {
+#ifdef LEAN_FLAT_TYPE_CHECKER_CACHES
+        /* Open-addressing tables, opt-in until benchmarks show them ahead of the node-based maps */
+        typedef expr_flat_map infer_cache;
+#else
         typedef expr_map<expr> infer_cache;
+#endif
         typedef std::unordered_set<expr_pair, expr_pair_hash, expr_pair_eq> expr_pair_set;
         environment               m_env;
         name_generator            m_ngen;
         infer_cache               m_infer_type[2];
-        expr_map<expr>            m_whnf_core;
-        expr_map<expr>            m_whnf;
+        infer_cache               m_whnf_core;
+        infer_cache               m_whnf;
         equiv_manager             m_eqv_manager;
         expr_pair_set             m_failure;
         friend type_checker;
@@ -805,6 +805,9 @@ name get_dep_cases_on(environment const &, name const & n) {
     return name(n, g_cases_on);
 }
 
+#ifndef LEAN_KERNEL_ONLY
+/* Implemented in `Lean.Compiler.Old`, the one module of `lean_export/` that the `kernel_only` target
+   in `main/BUILD` does not compile. Only used by `library/compiler`, which no target builds. */
 extern "C" object * lean_mk_unsafe_rec_name(object *);
 extern "C" object * lean_is_unsafe_rec_name(object *);
 
@@ -815,6 +818,7 @@ name mk_unsafe_rec_name(name const & n) {
 optional<name> is_unsafe_rec_name(name const & n) {
     return option_ref<name>(lean_is_unsafe_rec_name(n.to_obj_arg())).get();
 }
+#endif
 
 static std::string * g_short_version_string = nullptr;
 std::string const & get_short_version_string() { return *g_short_version_string; }
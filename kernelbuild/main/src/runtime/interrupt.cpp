@@ -20,6 +20,8 @@ void inc_heartbeat() { g_heartbeat++; }
 
 void reset_heartbeat() { g_heartbeat = 0; }
 
+size_t get_heartbeat() { return g_heartbeat; }
+
 void set_max_heartbeat(size_t max) { g_max_heartbeat = max; }
 
 size_t get_max_heartbeat() { return g_max_heartbeat; }
@@ -18,6 +18,9 @@ LEAN_EXPORT void inc_heartbeat();
 /** \brief Reset thread local counter for approximating elapsed time. */
 LEAN_EXPORT void reset_heartbeat();
 
+/** \brief Return the thread local counter for approximating elapsed time. */
+LEAN_EXPORT size_t get_heartbeat();
+
 /* Update the current heartbeat */
 class scope_heartbeat : flet<size_t> {
 public:
@@ -124,6 +124,12 @@ void set_max_memory_megabyte(unsigned max) {
     set_max_memory(m);
 }
 
+size_t get_max_memory() {
+    return g_max_memory;
+}
+
+scope_max_memory::scope_max_memory(size_t max):flet<size_t>(g_max_memory, max) {}
+
 // separate definition to allow breakpoint in debugger
 void throw_memory_exception(char const * component_name) {
     throw memory_exception(component_name);
@@ -7,12 +7,21 @@ Author: Leonardo de Moura
 #pragma once
 #include <cstdlib>
 #include <lean/lean.h>
+#include "runtime/flet.h"
 
 namespace lean {
 /** \brief Set maximum amount of memory in bytes */
 LEAN_EXPORT void set_max_memory(size_t max);
 /** \brief Set maximum amount of memory in megabytes */
 LEAN_EXPORT void set_max_memory_megabyte(unsigned max);
+LEAN_EXPORT size_t get_max_memory();
+
+/* Update the maximum amount of memory in bytes, 0 means unlimited */
+class LEAN_EXPORT scope_max_memory : flet<size_t> {
+public:
+    LEAN_EXPORT scope_max_memory(size_t max);
+};
+
 LEAN_EXPORT void check_memory(char const * component_name);
 LEAN_EXPORT size_t get_allocated_memory();
 }
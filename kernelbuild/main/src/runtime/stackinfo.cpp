@@ -132,5 +132,16 @@ void check_stack(char const * component_name) {
     if (curr_stack < g_stack_threshold)
         throw_stack_space_exception(component_name);
 }
+
+static size_t stack_threshold_for(size_t max) {
+    if (!g_stack_info_init)
+        save_stack_info(false);
+    size_t curr_stack = reinterpret_cast<size_t>(get_stack_pointer());
+    if (max > 0 && curr_stack > max && curr_stack - max > g_stack_threshold)
+        return curr_stack - max;
+    return g_stack_threshold;
+}
+
+scope_max_stack::scope_max_stack(size_t max):flet<size_t>(g_stack_threshold, stack_threshold_for(max)) {}
 }
 #endif
@@ -7,6 +7,7 @@ Author: Leonardo de Moura
 #pragma once
 #include <cstdlib>
 #include <lean/lean.h>
+#include "runtime/flet.h"
 
 namespace lean {
 #if defined(LEAN_USE_SPLIT_STACK)
@@ -16,6 +17,10 @@ inline size_t get_stack_size(bool ) { return 8192*1024; }
 inline void save_stack_info(bool = true) {}
 inline size_t get_used_stack_size() { return 0; }
 inline size_t get_available_stack_size() { return 8192*1024; }
+class scope_max_stack {
+public:
+    scope_max_stack(size_t) {}
+};
 #else
 LEAN_EXPORT size_t get_stack_size(bool main);
 LEAN_EXPORT void save_stack_info(bool main = true);
@@ -28,6 +33,17 @@ LEAN_EXPORT size_t get_available_stack_size();
    user which module is the potential offender.
 */
 LEAN_EXPORT void check_stack(char const * component_name);
+
+/**
+   \brief Limit the stack space available to the current thread to \c max bytes below
+   the current stack pointer, for the lifetime of the object. \c check_stack throws if the
+   limit is exceeded. A limit of 0, or one that is larger than the remaining stack space,
+   has no effect.
+*/
+class LEAN_EXPORT scope_max_stack : flet<size_t> {
+public:
+    LEAN_EXPORT scope_max_stack(size_t max);
+};
 #endif
 
 }
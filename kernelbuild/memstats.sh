@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+# Sums the memory usage of all running fuzzing instances. PSS divides pages shared between
+# instances (such as the prelude snapshot) by the number of processes mapping them, so the
+# PSS total is the real footprint of the campaign, whereas the RSS total counts them repeatedly.
+
+pattern=${1:-parser.afl}
+
+total_rss=0
+total_pss=0
+count=0
+for pid in $(pgrep -f "$pattern"); do
+  [[ -r /proc/$pid/smaps_rollup ]] || continue
+  rss=$(awk '/^Rss:/ { print $2 }' /proc/$pid/smaps_rollup)
+  pss=$(awk '/^Pss:/ { print $2 }' /proc/$pid/smaps_rollup)
+  [[ -n "$rss" && -n "$pss" ]] || continue
+  printf '%8d rss=%8d kB pss=%8d kB\n' "$pid" "$rss" "$pss"
+  total_rss=$((total_rss + rss))
+  total_pss=$((total_pss + pss))
+  count=$((count + 1))
+done
+
+printf '%d processes: rss=%d kB pss=%d kB\n' "$count" "$total_rss" "$total_pss"
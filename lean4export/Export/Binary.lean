@@ -13,6 +13,9 @@ structure Context where
   goodIndices : Array ModuleIdx
   strings : Array String
   stringMap : HashMap String Nat
+  /-- Version 1 uses big-endian `u16` indices and `u8` lengths. Version 2 starts with a header and
+  uses LEB128 varints for all indices, lengths and numbers, see the README. -/
+  version : Nat := 1
 
 structure State where
   visitedNames : HashMap Name Nat := .insert {} .anonymous 0
@@ -20,6 +23,8 @@ structure State where
   visitedExprs : HashMap Expr Nat := {}
   visitedRecRules : HashMap RecursorRule Nat := {}
   visitedConstants : NameHashSet := {}
+  /-- Definitions, theorems and inductive families written so far, for the version 2 header -/
+  numDecls : Nat := 0
   data : ByteArray := {}
 
 abbrev M := ReaderT Context <| StateT State IO
@@ -30,13 +35,29 @@ def computeStringMap (names : Array String) : HashMap String Nat := Id.run do
     m := m.insert names[i] i
   return m
 
-def M.run (env : Environment) (goodIndices : Array ModuleIdx) (strings : Array String) (act : M α) : IO α :=
+def M.run (env : Environment) (goodIndices : Array ModuleIdx) (strings : Array String) (act : M α)
+    (version : Nat := 1) : IO α :=
   StateT.run' (s := {}) <| Id.run do
-    ReaderT.run (r := { env, goodIndices, strings, stringMap := computeStringMap strings }) do
+    ReaderT.run (r := { env, goodIndices, strings, stringMap := computeStringMap strings, version }) do
       act
 
+partial def ulebBytes (n : Nat) : List UInt8 :=
+  if n < 128 then
+    [n.toUInt8]
+  else
+    (n % 128 + 128).toUInt8 :: ulebBytes (n / 128)
+
+/-- `kfbin`, the version, flags (bit 0: the table sizes follow) and the table sizes -/
+def header : M ByteArray := do
+  let st ← get
+  let sizes := [st.visitedNames.size - 1, st.visitedLevels.size - 1, st.visitedExprs.size, st.numDecls]
+  return ⟨#[0x6b, 0x66, 0x62, 0x69, 0x6e, 2, 1] ++ (sizes.flatMap ulebBytes).toArray⟩
+
 def writeBinaryData (s : String) : M Unit := do
-  IO.FS.writeBinFile s (← get).data
+  if (← read).version == 2 then
+    IO.FS.writeBinFile s ((← header) ++ (← get).data)
+  else
+    IO.FS.writeBinFile s (← get).data
 
 def pushUInt8 (b : UInt8) : M Unit :=
   modify (fun s => { s with data := s.data.push b })
@@ -49,14 +70,23 @@ def pushUInt32 (b : UInt32) : M Unit := do
   pushUInt16 (b >>> 16).toUInt16
   pushUInt16 b.toUInt16
 
-def pushNat8 (b : Nat) : M Unit :=
-  if h : b < UInt8.size then
+def pushULEB128 (b : Nat) : M Unit :=
+  (ulebBytes b).forM pushUInt8
+
+/-- A length or small number: `u8` in version 1 -/
+def pushNat8 (b : Nat) : M Unit := do
+  if (← read).version == 2 then
+    pushULEB128 b
+  else if h : b < UInt8.size then
     pushUInt8 (UInt8.ofNatLT b h)
   else
     panic! "Nat overflow"
 
-def pushNat16 (b : Nat) : M Unit :=
-  if h : b < UInt16.size then
+/-- An index or number: `u16` in version 1 -/
+def pushNat16 (b : Nat) : M Unit := do
+  if (← read).version == 2 then
+    pushULEB128 b
+  else if h : b < UInt16.size then
     pushUInt16 (UInt16.ofNatLT b h)
   else
     panic! "Nat overflow"
@@ -288,7 +318,10 @@ def dumpHints : ReducibilityHints → M Unit
   | .abbrev => pushU8 1
   | .regular n => do
     pushU8 2
-    pushUInt32 n
+    if (← read).version == 2 then
+      pushULEB128 n.toNat
+    else
+      pushUInt32 n
 
 partial def dumpConstant (c : Name) : M Unit := do
   if (← get).visitedConstants.contains c then
@@ -316,6 +349,7 @@ partial def dumpConstant (c : Name) : M Unit := do
     pushN16 eidx₂
     dumpHints val.hints
     pushNat16s names
+    countDecl
   | .thmInfo val => do
     modify fun st => { st with visitedConstants := st.visitedConstants.insert c }
     dumpDeps val.type
@@ -331,6 +365,7 @@ partial def dumpConstant (c : Name) : M Unit := do
     pushN16 eidx₁
     pushN16 eidx₂
     pushNat16s names
+    countDecl
   | .opaqueInfo _ => do
     panic! "No opaques in binary mode"
   | .quotInfo _ =>
@@ -356,6 +391,8 @@ partial def dumpConstant (c : Name) : M Unit := do
     discard <| dumpName val.name
     return
 where
+  countDecl : M Unit :=
+    modify fun st => { st with numDecls := st.numDecls + 1 }
   dumpDeps e := do
     for c in e.getUsedConstants do
       dumpConstant c
@@ -395,5 +432,6 @@ where
     pushN8 numParams
     pushNat16s indNameIdxs
     pushNat16s levelIdxs
+    countDecl
 
 end Binary
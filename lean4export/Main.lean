@@ -24,10 +24,12 @@ def binaryMode : Bool := true
 
 /-
 Example usage: lake exe lean4export Corpus.ExtendedPrelude
+Pass `--v2` to write version 2 of the binary format.
 -/
 def main (args : List String) : IO Unit := do
   initSearchPath (← findSysroot)
-  let imports := args
+  let binaryVersion := if args.contains "--v2" then 2 else 1
+  let imports := args.filter (· != "--v2")
   let names := imports.toArray.map fun mod => Syntax.decodeNameLit ("`" ++ mod) |>.get!
   let preludeMode := names.contains `Init.Prelude
   let imports := names.map ({ module := · })
@@ -45,7 +47,7 @@ def main (args : List String) : IO Unit := do
   else
     if binaryMode then
       let names ← readStringsFromFile "strings"
-      Binary.M.run env goodIndices names do
+      Binary.M.run env goodIndices names (version := binaryVersion) do
         for c in constants do
           let _ ← Binary.dumpConstant c
         let filename := s!"ExportedCorpus/{imports[0]!}.belean"